@@ -11,6 +11,7 @@ namespace {
 const int page_size	= 4096;
 int64_t nr_total_pages	= 256 * 1024;
 int64_t nr_slot_pages	= 256 * 1024;
+int64_t clear_chunk	= 0;	// 0: compare several chunk sizes
 
 // Return the current time in nanoseconds.
 uint64_t time_ns()
@@ -62,6 +63,33 @@ void check_dirty_log(kvm::vcpu& vcpu, mem_slot& slot, void* slot_head)
     slot.set_dirty_logging(false);
 }
 
+// The same with manual dirty protect, clearing the log in chunks of
+// chunk pages after getting it.
+void check_dirty_log_clear(kvm::vcpu& vcpu, mem_slot& slot, void* slot_head,
+                           int64_t chunk)
+{
+    slot.set_dirty_logging(true);
+    slot.update_dirty_log();
+    slot.clear_dirty_log_chunked(nr_slot_pages);
+
+    for (int64_t i = 1; i <= nr_slot_pages; i *= 2) {
+        do_guest_write(vcpu, slot_head, i, nr_slot_pages);
+
+        uint64_t start_ns = time_ns();
+        int n = slot.update_dirty_log();
+        uint64_t get_ns = time_ns();
+        int calls = slot.clear_dirty_log_chunked(chunk);
+        uint64_t end_ns = time_ns();
+
+        printf("get+clear %7lld: %10lld ns get, %10lld ns clear (%6d calls)"
+               " for %10d dirty pages (expected %lld)\n",
+               (long long)chunk, (long long)(get_ns - start_ns),
+               (long long)(end_ns - get_ns), calls, n, (long long)i);
+    }
+
+    slot.set_dirty_logging(false);
+}
+
 }
 
 void parse_options(int ac, char **av)
@@ -69,7 +97,7 @@ void parse_options(int ac, char **av)
     int opt;
     char *endptr;
 
-    while ((opt = getopt(ac, av, "n:m:")) != -1) {
+    while ((opt = getopt(ac, av, "n:m:c:")) != -1) {
         switch (opt) {
         case 'n':
             errno = 0;
@@ -93,6 +121,17 @@ void parse_options(int ac, char **av)
                 nr_total_pages *= 1024;
             }
             break;
+        case 'c':
+            errno = 0;
+            clear_chunk = strtol(optarg, &endptr, 10);
+            if (errno || endptr == optarg || clear_chunk <= 0) {
+                printf("dirty-log-perf: Invalid number: -c %s\n", optarg);
+                exit(1);
+            }
+            if (*endptr == 'k' || *endptr == 'K') {
+                clear_chunk *= 1024;
+            }
+            break;
         default:
             printf("dirty-log-perf: Invalid option\n");
             exit(1);
@@ -137,6 +176,20 @@ int test_main(int ac, char **av)
     // pre-allocate shadow pages
     do_guest_write(vcpu, mem_head, nr_total_pages, nr_total_pages);
     check_dirty_log(vcpu, slot, mem_head);
+
+    if (!memmap.set_manual_dirty_protect(true)) {
+        printf("dirty-log-perf: no KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2,"
+               " not testing KVM_CLEAR_DIRTY_LOG\n");
+        return 0;
+    }
+    if (clear_chunk) {
+        check_dirty_log_clear(vcpu, slot, mem_head, clear_chunk);
+    } else {
+        for (int64_t chunk = 64; chunk < nr_slot_pages; chunk *= 8) {
+            check_dirty_log_clear(vcpu, slot, mem_head, chunk);
+        }
+        check_dirty_log_clear(vcpu, slot, mem_head, nr_slot_pages);
+    }
     return 0;
 }
 
@@ -171,6 +171,25 @@ void vm::get_dirty_log(int slot, void *log)
     _fd.ioctlp(KVM_GET_DIRTY_LOG, &kdl);
 }
 
+void vm::clear_dirty_log(int slot, void *log, uint64_t first_page,
+                         uint32_t nr_pages)
+{
+    struct kvm_clear_dirty_log kcdl = {};
+    kcdl.slot = slot;
+    kcdl.first_page = first_page;
+    kcdl.num_pages = nr_pages;
+    kcdl.dirty_bitmap = log;
+    _fd.ioctlp(KVM_CLEAR_DIRTY_LOG, &kcdl);
+}
+
+void vm::enable_cap(uint32_t cap, uint64_t arg0)
+{
+    struct kvm_enable_cap kec = {};
+    kec.cap = cap;
+    kec.args[0] = arg0;
+    _fd.ioctlp(KVM_ENABLE_CAP, &kec);
+}
+
 void vm::set_tss_addr(uint32_t addr)
 {
     _fd.ioctl(KVM_SET_TSS_ADDR, addr);
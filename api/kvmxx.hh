@@ -60,6 +60,9 @@ public:
     void set_memory_region(int slot, void *addr, uint64_t gpa, size_t len,
                            uint32_t flags = 0);
     void get_dirty_log(int slot, void *log);
+    void clear_dirty_log(int slot, void *log, uint64_t first_page,
+                         uint32_t nr_pages);
+    void enable_cap(uint32_t cap, uint64_t arg0 = 0);
     void set_tss_addr(uint32_t addr);
     void set_ept_identity_map_addr(uint64_t addr);
     system& sys() { return _system; }
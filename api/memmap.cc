@@ -1,5 +1,6 @@
 
 #include "memmap.hh"
+#include <algorithm>
 #include <numeric>
 
 mem_slot::mem_slot(mem_map& map, uint64_t gpa, uint64_t size, void* hva)
@@ -78,6 +79,47 @@ int mem_slot::update_dirty_log()
                            });
 }
 
+bool mem_slot::any_dirty(uint64_t first_page, uint64_t nr_pages) const
+{
+    ulong first = first_page / bits_per_word;
+    ulong last = (first_page + nr_pages - 1) / bits_per_word;
+    for (ulong i = first; i <= last; ++i) {
+        if (_log[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mem_slot::clear_dirty_log(uint64_t first_page, uint64_t nr_pages)
+{
+    // update_dirty_log() has already write-protected them
+    if (!_map.manual_dirty_protect()) {
+        return;
+    }
+    _map._vm.clear_dirty_log(_slot, &_log[first_page / bits_per_word],
+                             first_page, nr_pages);
+}
+
+int mem_slot::clear_dirty_log_chunked(uint64_t chunk_pages)
+{
+    uint64_t nr_pages = _size >> 12;
+    int calls = 0;
+
+    if (!_map.manual_dirty_protect()) {
+        return 0;
+    }
+    chunk_pages = (chunk_pages + 63) & ~(uint64_t)63;
+    for (uint64_t first = 0; first < nr_pages; first += chunk_pages) {
+        uint64_t n = std::min(chunk_pages, nr_pages - first);
+        if (any_dirty(first, n)) {
+            clear_dirty_log(first, n);
+            ++calls;
+        }
+    }
+    return calls;
+}
+
 bool mem_slot::is_dirty(uint64_t gpa) const
 {
     uint64_t pagenr = (gpa - _gpa) >> 12;
@@ -88,9 +130,21 @@ bool mem_slot::is_dirty(uint64_t gpa) const
 
 mem_map::mem_map(kvm::vm& vm)
     : _vm(vm)
+    , _manual_dirty_protect(false)
 {
     int nr_slots = vm.sys().get_extension_int(KVM_CAP_NR_MEMSLOTS);
     for (int i = 0; i < nr_slots; ++i) {
         _free_slots.push(i);
     }
 }
+
+bool mem_map::set_manual_dirty_protect(bool enabled)
+{
+    if (!_vm.sys().check_extension(KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2)) {
+        return false;
+    }
+    _vm.enable_cap(KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2,
+                   enabled ? KVM_DIRTY_LOG_MANUAL_PROTECT_ENABLE : 0);
+    _manual_dirty_protect = enabled;
+    return true;
+}
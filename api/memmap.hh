@@ -16,9 +16,18 @@ public:
     void set_dirty_logging(bool enabled);
     bool dirty_logging() const;
     int update_dirty_log();
+    // With manual dirty protect, write-protects again the pages found
+    // dirty by update_dirty_log() among nr_pages from first_page, which
+    // must be a multiple of 64, as must nr_pages unless it ends the slot.
+    // Without it there is nothing to do, update_dirty_log() did that.
+    void clear_dirty_log(uint64_t first_page, uint64_t nr_pages);
+    // The same for the whole slot, chunk_pages at a time, skipping chunks
+    // with nothing dirty.  Returns the number of KVM_CLEAR_DIRTY_LOG calls.
+    int clear_dirty_log_chunked(uint64_t chunk_pages);
     bool is_dirty(uint64_t gpa) const;
 private:
     void update();
+    bool any_dirty(uint64_t first_page, uint64_t nr_pages) const;
 private:
     typedef unsigned long ulong;
     static const int bits_per_word = sizeof(ulong) * 8;
@@ -34,8 +43,14 @@ private:
 class mem_map {
 public:
     mem_map(kvm::vm& vm);
+    // KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2: getting the dirty log leaves the
+    // pages writable until mem_slot::clear_dirty_log().  Returns false if
+    // KVM does not support it.
+    bool set_manual_dirty_protect(bool enabled);
+    bool manual_dirty_protect() const { return _manual_dirty_protect; }
 private:
     kvm::vm& _vm;
+    bool _manual_dirty_protect;
     std::stack<int> _free_slots;
     friend class mem_slot;
 };
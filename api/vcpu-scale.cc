@@ -0,0 +1,239 @@
+#include "kvmxx.hh"
+#include "exception.hh"
+#include "memmap.hh"
+#include "identity.hh"
+#include "vcpu-threads.hh"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// How KVM_RUN, memslot updates and dirty logging scale with the number of
+// concurrently running vCPUs, 1, 2, 4... up to -v, each run in a new VM:
+//
+// - run: every vCPU exits to userspace -n times;
+// - memslot: the same while another thread keeps adding and removing a
+//   memslot;
+// - dirty: every vCPU writes its -p pages of a dirty logged slot -n / 1000
+//   times over while another thread keeps fetching the dirty log.
+//
+// -c pins vCPU i to the i-th host CPU of a comma separated list.
+
+namespace {
+
+const int page_size	= 4096;
+int max_vcpus		= 4;
+int64_t nr_exits	= 100000;
+int64_t nr_vcpu_pages	= 16 * 1024;
+std::vector<int> cpus;
+
+uint64_t time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+}
+
+void ping(int64_t n)
+{
+    for (int64_t i = 0; i < n; ++i) {
+        asm volatile("outb %%al, %%dx" : : "a"(0), "d"(1));
+    }
+}
+
+void write_pages(char* base, int64_t nr_pages, int64_t passes)
+{
+    for (int64_t p = 0; p < passes; ++p) {
+        for (int64_t i = 0; i < nr_pages; ++i) {
+            ++*(volatile char*)(base + i * page_size);
+        }
+    }
+}
+
+// Per vCPU, n vCPUs each with their own pages, then one spare page
+struct guest_mem {
+    explicit guest_mem(int nr_vcpus);
+    ~guest_mem() { free(base); }
+    char* vcpu_pages(int index) { return base + index * nr_vcpu_pages * page_size; }
+    uint64_t gpa() { return reinterpret_cast<uintptr_t>(base); }
+    char* base;
+    uint64_t size;	// without the spare page
+};
+
+guest_mem::guest_mem(int nr_vcpus)
+    : size(nr_vcpus * nr_vcpu_pages * page_size)
+{
+    void* p;
+    int ret = posix_memalign(&p, page_size, size + page_size);
+    if (ret) {
+        throw errno_exception(ret);
+    }
+    memset(p, 0, size + page_size);
+    base = static_cast<char*>(p);
+}
+
+void run_test(const std::string& mode, int nr_vcpus)
+{
+    kvm::system sys;
+    kvm::vm vm(sys);
+    mem_map memmap(vm);
+    guest_mem mem(nr_vcpus);
+    identity::hole hole(mem.base, mem.size + page_size);
+    identity::vm ident_vm(vm, memmap, hole);
+    mem_slot slot(memmap, mem.gpa(), mem.size, mem.base);
+    int64_t passes = std::max<int64_t>(nr_exits / 1000, 1);
+
+    std::function<void (int)> guest;
+    if (mode == "dirty") {
+        slot.set_dirty_logging(true);
+        guest = [&mem, passes] (int i) {
+            write_pages(mem.vcpu_pages(i), nr_vcpu_pages, passes);
+        };
+    } else {
+        guest = [] (int i) { ping(nr_exits); };
+    }
+
+    vcpu_threads threads(vm, nr_vcpus, guest, cpus);
+    std::atomic<bool> stop(false);
+    uint64_t nr_ops = 0, max_ns = 0, sum_ns = 0, nr_dirty = 0;
+    std::thread host;
+    if (mode == "memslot") {
+        host = std::thread([&] {
+            while (!stop) {
+                mem_slot spare(memmap, mem.gpa() + mem.size, page_size,
+                               mem.base + mem.size);
+                ++nr_ops;
+            }
+        });
+    } else if (mode == "dirty") {
+        host = std::thread([&] {
+            while (!stop) {
+                uint64_t t0 = time_ns();
+                nr_dirty += slot.update_dirty_log();
+                uint64_t ns = time_ns() - t0;
+                sum_ns += ns;
+                max_ns = std::max(max_ns, ns);
+                ++nr_ops;
+            }
+        });
+    }
+
+    threads.start();
+    threads.join();
+    stop = true;
+    if (host.joinable()) {
+        host.join();
+    }
+
+    vcpu_threads::stats st = threads.total();
+    uint64_t us = std::max<uint64_t>(threads.elapsed_ns() / 1000, 1);
+    printf("%-7s %3d vcpus: %8lld us", mode.c_str(), nr_vcpus,
+           (long long)us);
+    if (mode == "dirty") {
+        printf(", %lld pages/s, %lld get-dirty-log (avg %lld us, max %lld us,"
+               " %lld dirty pages)\n",
+               (long long)(nr_vcpus * nr_vcpu_pages * passes * 1000000 / us),
+               (long long)nr_ops, (long long)(nr_ops ? sum_ns / nr_ops / 1000 : 0),
+               (long long)(max_ns / 1000),
+               (long long)(nr_ops ? nr_dirty / nr_ops : 0));
+        return;
+    }
+    printf(", %lld exits/s, %lld ns per KVM_RUN",
+           (long long)(st.exits[KVM_EXIT_IO] * 1000000 / us),
+           (long long)(st.run_ns / st.runs));
+    if (mode == "memslot") {
+        printf(", %lld memslot updates/s", (long long)(nr_ops * 1000000 / us));
+    }
+    printf("\n");
+}
+
+int64_t parse_number(char opt, const char* arg)
+{
+    char *endptr;
+
+    errno = 0;
+    int64_t n = strtoll(arg, &endptr, 10);
+    if (errno || endptr == arg || n <= 0) {
+        printf("vcpu-scale: Invalid number: -%c %s\n", opt, arg);
+        exit(1);
+    }
+    if (*endptr == 'k' || *endptr == 'K') {
+        n *= 1024;
+    }
+    return n;
+}
+
+void parse_cpus(const char* arg)
+{
+    std::string list(arg);
+    size_t pos = 0;
+
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string cpu = list.substr(pos, comma - pos);
+        char *endptr;
+        errno = 0;
+        long n = strtol(cpu.c_str(), &endptr, 10);
+        if (errno || endptr == cpu.c_str() || *endptr || n < 0) {
+            printf("vcpu-scale: Invalid CPU list: -c %s\n", arg);
+            exit(1);
+        }
+        cpus.push_back(n);
+        pos = comma + 1;
+    }
+}
+
+}
+
+int test_main(int ac, char **av)
+{
+    int opt;
+
+    while ((opt = getopt(ac, av, "v:n:p:c:")) != -1) {
+        switch (opt) {
+        case 'v':
+            max_vcpus = parse_number(opt, optarg);
+            break;
+        case 'n':
+            nr_exits = parse_number(opt, optarg);
+            break;
+        case 'p':
+            nr_vcpu_pages = parse_number(opt, optarg);
+            break;
+        case 'c':
+            parse_cpus(optarg);
+            break;
+        default:
+            printf("vcpu-scale: Invalid option\n");
+            return 1;
+        }
+    }
+
+    std::vector<std::string> modes(av + optind, av + ac);
+    if (modes.empty()) {
+        modes = { "run", "memslot", "dirty" };
+    }
+    for (auto& mode : modes) {
+        if (mode != "run" && mode != "memslot" && mode != "dirty") {
+            printf("vcpu-scale: Invalid mode: %s\n", mode.c_str());
+            return 1;
+        }
+        for (int n = 1; n <= max_vcpus; n = n == max_vcpus ? n + 1
+                                                : std::min(n * 2, max_vcpus)) {
+            run_test(mode, n);
+        }
+    }
+    return 0;
+}
+
+int main(int ac, char** av)
+{
+    return try_main(test_main, ac, av);
+}
@@ -0,0 +1,172 @@
+#include "vcpu-threads.hh"
+#include "identity.hh"
+#include "exception.hh"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+namespace {
+
+uint64_t time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+}
+
+void pin_to(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret) {
+        throw errno_exception(ret);
+    }
+}
+
+}
+
+vcpu_threads::stats::stats()
+    : runs(), run_ns()
+{
+    std::fill(exits, exits + nr_exit_reasons, 0);
+}
+
+vcpu_threads::stats& vcpu_threads::stats::operator+=(const stats& other)
+{
+    runs += other.runs;
+    run_ns += other.run_ns;
+    for (int i = 0; i < nr_exit_reasons; ++i) {
+        exits[i] += other.exits[i];
+    }
+    return *this;
+}
+
+vcpu_threads::vcpu_threads(kvm::vm& vm, int nr_vcpus,
+                           std::function<void (int)> guest_func,
+                           std::vector<int> cpus)
+    : _vm(vm), _guest_func(guest_func), _nr_ready(), _started(false)
+    , _joined(false), _start_ns(), _end_ns()
+{
+    for (int i = 0; i < nr_vcpus; ++i) {
+        std::unique_ptr<vcpu_thread> t(new vcpu_thread());
+        t->index = i;
+        t->cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        t->end_ns = 0;
+        _vcpus.push_back(std::move(t));
+    }
+    for (auto& t : _vcpus) {
+        t->thread = std::thread(&vcpu_threads::thread_main, this,
+                                std::ref(*t));
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.wait(lock, [this] { return _nr_ready == size(); });
+}
+
+vcpu_threads::~vcpu_threads()
+{
+    try {
+        join();
+    } catch (...) {
+        // the errors are only reported by an explicit join()
+    }
+}
+
+void vcpu_threads::start()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _start_ns = time_ns();
+    _started = true;
+    _cond.notify_all();
+}
+
+void vcpu_threads::join()
+{
+    if (_joined) {
+        return;
+    }
+    if (!_started) {
+        start();
+    }
+    _joined = true;
+    for (auto& t : _vcpus) {
+        t->thread.join();
+        _end_ns = std::max(_end_ns, t->end_ns);
+    }
+    for (auto& t : _vcpus) {
+        if (t->error) {
+            std::rethrow_exception(t->error);
+        }
+    }
+}
+
+const vcpu_threads::stats& vcpu_threads::vcpu_stats(int index) const
+{
+    return _vcpus[index]->st;
+}
+
+vcpu_threads::stats vcpu_threads::total() const
+{
+    stats sum;
+
+    for (auto& t : _vcpus) {
+        sum += t->st;
+    }
+    return sum;
+}
+
+void vcpu_threads::wait_for_start()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    ++_nr_ready;
+    _cond.notify_all();
+    _cond.wait(lock, [this] { return _started; });
+}
+
+void vcpu_threads::run_vcpu(vcpu_thread& t)
+{
+    if (t.cpu >= 0) {
+        pin_to(t.cpu);
+    }
+
+    // Created here, so that KVM sees the thread that runs the vCPU
+    kvm::vcpu vcpu(_vm, t.index);
+    identity::vcpu guest(vcpu, std::bind(_guest_func, t.index));
+    kvm_run* run = vcpu.shared();
+
+    wait_for_start();
+
+    for (;;) {
+        uint64_t t0 = time_ns();
+        vcpu.run();
+        t.st.run_ns += time_ns() - t0;
+        ++t.st.runs;
+        ++t.st.exits[std::min<uint32_t>(run->exit_reason,
+                                        nr_exit_reasons - 1)];
+        if (run->exit_reason == KVM_EXIT_IO && run->io.port == 0) {
+            break;
+        }
+    }
+}
+
+void vcpu_threads::thread_main(vcpu_thread& t)
+{
+    try {
+        run_vcpu(t);
+    } catch (...) {
+        t.error = std::current_exception();
+        // if that was before the barrier, don't keep the others waiting
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_started) {
+            ++_nr_ready;
+            _cond.notify_all();
+        }
+    }
+    t.end_ns = time_ns();
+}
@@ -0,0 +1,69 @@
+#ifndef API_VCPU_THREADS_HH
+#define API_VCPU_THREADS_HH
+
+#include "kvmxx.hh"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a guest function on several vCPUs of an identity mapped VM (see
+// identity.hh), each vCPU created and run by its own thread, optionally
+// pinned to a host CPU.  The threads set up their vCPU and then wait until
+// start() lets them all enter the guest at once.  A vCPU is re-entered
+// after every exit until the guest function returns; exits are counted
+// by reason, so the guest can force one with e.g. an OUT to any port but
+// 0, which marks the end of the guest function.
+class vcpu_threads {
+public:
+    static const int nr_exit_reasons = 64;
+    struct stats {
+        stats();
+        stats& operator+=(const stats& other);
+        uint64_t runs;		// KVM_RUN calls
+        uint64_t run_ns;	// time spent in them
+        uint64_t exits[nr_exit_reasons];	// the last one counts the rest
+    };
+public:
+    // cpus[i % cpus.size()] is the host CPU for vCPU i, if cpus is not empty
+    vcpu_threads(kvm::vm& vm, int nr_vcpus,
+                 std::function<void (int vcpu_index)> guest_func,
+                 std::vector<int> cpus = std::vector<int>());
+    ~vcpu_threads();
+    void start();
+    // Waits for all vCPUs to finish, rethrowing the first error of any.
+    void join();
+    int size() const { return _vcpus.size(); }
+    const stats& vcpu_stats(int index) const;
+    stats total() const;
+    // From start() to the last vCPU finishing
+    uint64_t elapsed_ns() const { return _end_ns - _start_ns; }
+private:
+    struct vcpu_thread {
+        int index;
+        int cpu;
+        stats st;
+        uint64_t end_ns;
+        std::exception_ptr error;
+        std::thread thread;
+    };
+    void thread_main(vcpu_thread& t);
+    void run_vcpu(vcpu_thread& t);
+    void wait_for_start();
+private:
+    kvm::vm& _vm;
+    std::function<void (int)> _guest_func;
+    std::vector<std::unique_ptr<vcpu_thread>> _vcpus;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _nr_ready;
+    bool _started;
+    bool _joined;
+    uint64_t _start_ns;
+    uint64_t _end_ns;
+};
+
+#endif
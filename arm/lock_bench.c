@@ -0,0 +1 @@
+../common/lock_bench.c
\ No newline at end of file
@@ -5,11 +5,11 @@
  * operations. To improve precision in the measurements, one should
  * consider pinning each VCPU to a specific physical CPU (PCPU) and to
  * ensure no other task could run on that PCPU to skew the results.
- * This can be achieved by enabling QMP server in the QEMU command in
- * unittest.cfg for micro-bench, allowing a client program to get the
- * thread_id for each VCPU thread from the QMP server. Based on that
- * information, the client program can then pin the corresponding VCPUs to
- * dedicated PCPUs and isolate interrupts and tasks from those PCPUs.
+ * This can be achieved with PIN_VCPUS (and PIN_EMULATOR), which make the
+ * run script get the thread_id for each VCPU thread from QMP and pin the
+ * corresponding VCPUs to the given PCPUs before the guest starts, see
+ * pin_vcpus() in scripts/arch-run.bash. Interrupts and other tasks still
+ * need to be kept away from those PCPUs by hand.
  *
  * Copyright Columbia University
  * Author: Shih-Wei Li <shihwei@cs.columbia.edu>
@@ -0,0 +1,272 @@
+/*
+ * Lock contention benchmark
+ *
+ * Hammers one lock from 1, 2, 4... CPUs for a fixed time and reports, for
+ * the arch test-and-set spinlock and the ticket, MCS and queued spinlocks
+ * from lib/locks.c:
+ *
+ * - acquisitions per second, summed over all CPUs;
+ * - fairness, the fewest acquisitions of any CPU relative to the most;
+ * - the 99th percentile and the maximum time spent waiting for the lock.
+ *
+ * Under KVM the tail wait time is where vCPU preemption shows up: a fair
+ * lock whose next owner is not running stalls every CPU behind it.
+ *
+ * Usage: -append "[ms=<time per run>] [tas] [ticket] [mcs] [qspinlock]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/smp.h>
+#include <asm/barrier.h>
+#include <asm/spinlock.h>
+#include <asm-generic/atomic.h>
+#include <bitops.h>
+#include <locks.h>
+#include <util.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <processor.h>
+#include <delay.h>
+
+static void arch_init(void)
+{
+	smp_init();
+}
+
+static u64 now(void)
+{
+	return rdtsc();
+}
+
+static u64 ticks_per_sec(void)
+{
+	return tsc_khz() * 1000;
+}
+#else
+#include <asm/processor.h>
+
+static void arch_init(void)
+{
+}
+
+static u64 now(void)
+{
+	return get_cntvct();
+}
+
+static u64 ticks_per_sec(void)
+{
+	return get_cntfrq();
+}
+#endif
+
+#define MAX_CPUS	QSPIN_MAX_CPUS
+#define NR_BUCKETS	64
+#define NO_OWNER	-1
+
+struct lock_stats {
+	ulong acquired;
+	ulong errors;
+	u64 max_wait;
+	ulong wait_hist[NR_BUCKETS];	/* by log2 of the wait time */
+} __attribute__((aligned(64)));
+
+static struct spinlock tas;
+static struct ticket_lock ticket;
+static struct mcs_lock mcs;
+static struct qspinlock qspin;
+static struct mcs_node mcs_nodes[MAX_CPUS];
+
+static void tas_lock_cpu(int cpu) { spin_lock(&tas); }
+static void tas_unlock_cpu(int cpu) { spin_unlock(&tas); }
+static void ticket_lock_cpu(int cpu) { ticket_lock(&ticket); }
+static void ticket_unlock_cpu(int cpu) { ticket_unlock(&ticket); }
+static void mcs_lock_cpu(int cpu) { mcs_lock(&mcs, &mcs_nodes[cpu]); }
+static void mcs_unlock_cpu(int cpu) { mcs_unlock(&mcs, &mcs_nodes[cpu]); }
+static void qspin_lock_cpu(int cpu) { qspin_lock(&qspin, cpu); }
+static void qspin_unlock_cpu(int cpu) { qspin_unlock(&qspin); }
+
+struct lock_type {
+	const char *name;
+	void (*lock)(int cpu);
+	void (*unlock)(int cpu);
+};
+
+static struct lock_type lock_types[] = {
+	{ "tas", tas_lock_cpu, tas_unlock_cpu },
+	{ "ticket", ticket_lock_cpu, ticket_unlock_cpu },
+	{ "mcs", mcs_lock_cpu, mcs_unlock_cpu },
+	{ "qspinlock", qspin_lock_cpu, qspin_unlock_cpu },
+};
+
+/* Protected by the lock under test, one cache line of its own. */
+static struct {
+	volatile int owner;
+	volatile ulong count;
+} __attribute__((aligned(64))) shared = { NO_OWNER };
+
+static struct lock_stats stats[MAX_CPUS];
+static struct lock_type *cur;
+static u64 duration;
+static int nr_online, nr_workers;
+static int next_id, nr_arrived;
+
+static void count_cpu(void *data)
+{
+	atomic_fetch_inc(&nr_online);
+}
+
+static void hammer(void *data)
+{
+	int id = atomic_fetch_inc(&next_id);
+	struct lock_stats *s;
+	u64 start, t, wait;
+
+	if (id >= nr_workers)
+		return;
+
+	s = &stats[id];
+	memset(s, 0, sizeof(*s));
+
+	atomic_fetch_inc(&nr_arrived);
+	while (*(volatile int *)&nr_arrived < nr_workers)
+		cpu_relax();
+
+	start = now();
+	do {
+		t = now();
+		cur->lock(id);
+		wait = now() - t;
+
+		if (shared.owner != NO_OWNER)
+			s->errors++;
+		shared.owner = id;
+		shared.count++;
+		if (shared.owner != id)
+			s->errors++;
+		shared.owner = NO_OWNER;
+
+		cur->unlock(id);
+
+		s->acquired++;
+		s->max_wait = MAX(s->max_wait, wait);
+		s->wait_hist[fls(wait | 1)]++;
+	} while (now() - start < duration);
+}
+
+/* Upper bound of the histogram bucket holding the 99th percentile. */
+static u64 p99_wait(ulong *hist, ulong total)
+{
+	ulong seen = 0;
+	int i;
+
+	for (i = 0; i < NR_BUCKETS - 1; i++) {
+		seen += hist[i];
+		if (seen * 100 >= total * 99)
+			break;
+	}
+	return 2ull << i;
+}
+
+static void print_ticks(const char *name, u64 ticks, u64 hz)
+{
+	if (hz)
+		printf(" %s %" PRIu64 " ns", name, ticks * 1000000000 / hz);
+	else
+		printf(" %s %" PRIu64 " cycles", name, ticks);
+}
+
+static bool run(struct lock_type *type, int workers, u64 hz)
+{
+	ulong hist[NR_BUCKETS] = { 0 };
+	ulong total = 0, errors = 0, least = ~0ul, most = 0;
+	u64 max_wait = 0;
+	int i, j;
+
+	cur = type;
+	nr_workers = workers;
+	next_id = 0;
+	nr_arrived = 0;
+	on_cpus(hammer, NULL);
+
+	for (i = 0; i < workers; i++) {
+		total += stats[i].acquired;
+		errors += stats[i].errors;
+		least = MIN(least, stats[i].acquired);
+		most = MAX(most, stats[i].acquired);
+		max_wait = MAX(max_wait, stats[i].max_wait);
+		for (j = 0; j < NR_BUCKETS; j++)
+			hist[j] += stats[i].wait_hist[j];
+	}
+
+	printf("%-9s %3d cpus: %9lu acquisitions", type->name, workers, total);
+	if (hz)
+		printf(", %" PRIu64 "/s", total * hz / duration);
+	printf(", fairness %lu%%", least * 100 / most);
+	print_ticks("p99 wait", p99_wait(hist, total), hz);
+	print_ticks("max wait", max_wait, hz);
+	printf("\n");
+
+	return errors == 0;
+}
+
+/* 1, 2, 4... CPUs, always ending with all of them */
+static int next_workers(int workers)
+{
+	return workers == nr_online ? nr_online + 1 :
+				      MIN(workers * 2, nr_online);
+}
+
+static bool type_wanted(struct lock_type *type, char **wanted, int nwanted)
+{
+	int i;
+
+	if (!nwanted)
+		return true;
+
+	for (i = 0; i < nwanted; i++)
+		if (!strcmp(wanted[i], type->name))
+			return true;
+
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	char *wanted[ARRAY_SIZE(lock_types)];
+	int nwanted = 0, i, workers;
+	long ms = 200;
+	u64 hz;
+
+	arch_init();
+	on_cpus(count_cpu, NULL);
+	if (nr_online > MAX_CPUS)
+		report_abort("%d cpus, at most %d supported", nr_online, MAX_CPUS);
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "ms=", 3) && parse_keyval(argv[i], &ms) > 0)
+			continue;
+		if (nwanted == ARRAY_SIZE(wanted))
+			report_abort("too many arguments");
+		wanted[nwanted++] = argv[i];
+	}
+
+	hz = ticks_per_sec();
+	duration = (hz ? hz : 1000000000ull) / 1000 * ms;
+	printf("%d cpus, %ld ms per run%s\n", nr_online, ms,
+	       hz ? "" : ", timer frequency unknown, assuming 1 GHz");
+
+	for (i = 0; i < ARRAY_SIZE(lock_types); i++) {
+		bool ok = true;
+
+		if (!type_wanted(&lock_types[i], wanted, nwanted))
+			continue;
+		for (workers = 1; workers <= nr_online;
+		     workers = next_workers(workers))
+			ok &= run(&lock_types[i], workers, hz);
+		report("%s: mutual exclusion", ok, lock_types[i].name);
+	}
+
+	return report_summary();
+}
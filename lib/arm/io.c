@@ -79,11 +79,26 @@ void io_init(void)
 	chr_testdev_init();
 }
 
-void puts(const char *s)
+static void uart_puts(const char *s)
 {
-	spin_lock(&uart_lock);
 	while (*s)
 		writeb(*s++, uart0_base);
+}
+
+void puts(const char *s)
+{
+	char msg[64];
+	int ret;
+
+	spin_lock(&uart_lock);
+	ret = chr_testdev_puts(s);
+	if (ret < 0) {
+		snprintf(msg, sizeof(msg),
+			 "virtio-console output failed (%d), using the uart\n", ret);
+		uart_puts(msg);
+	}
+	if (ret <= 0)
+		uart_puts(s);
 	spin_unlock(&uart_lock);
 }
 
@@ -11,63 +11,205 @@
 
 #define TESTDEV_NAME "chr-testdev"
 
+/*
+ * Output goes through a ring of buffers. A buffer is queued at the end of
+ * every line or once full, the device is only notified once per
+ * VCON_BATCH queued buffers, when the ring is full and on exit, and
+ * completed buffers are reclaimed whenever we come by, so that writers
+ * only wait when the whole ring is in flight. virtio-console completes
+ * buffers in order, which lets the ring be reused in order as well.
+ * Should the guest hang, up to VCON_BATCH - 1 lines queued since the
+ * last notification are not written out.
+ */
+#define VCON_NR_BUFS	8
+#define VCON_BUF_SIZE	512
+#define VCON_BATCH	4
+
+struct vcon_out {
+	struct virtqueue *vq;
+	char bufs[VCON_NR_BUFS][VCON_BUF_SIZE];
+	unsigned int cur;	/* the buffer being filled */
+	unsigned int fill;	/* bytes in it */
+	unsigned int inflight;	/* buffers queued and not yet reclaimed */
+	unsigned int unkicked;	/* buffers queued since the last notify */
+};
+
+/*
+ * offsetof(struct virtio_console_config, max_nr_ports). The console
+ * carrying puts() output is told apart from chr-testdev by being the
+ * one with a single port, see arm/run. Legacy virtio config space is
+ * guest endian.
+ */
+#define VCON_CONFIG_MAX_NR_PORTS	4
+
 static struct virtio_device *vcon;
-static struct virtqueue *in_vq, *out_vq;
+static struct virtqueue *in_vq;
+static struct vcon_out testdev_out, console_out;
 static struct spinlock lock;
 
-static void __testdev_send(char *buf, unsigned int len)
+static void vcon_reclaim(struct vcon_out *out)
+{
+	unsigned int len;
+
+	while (out->inflight && virtqueue_get_buf(out->vq, &len))
+		out->inflight--;
+}
+
+static void vcon_kick(struct vcon_out *out)
+{
+	if (out->unkicked) {
+		virtqueue_kick(out->vq);
+		out->unkicked = 0;
+	}
+}
+
+static int vcon_submit(struct vcon_out *out)
 {
 	int ret;
 
-	ret = virtqueue_add_outbuf(out_vq, buf, len);
-	virtqueue_kick(out_vq);
+	if (!out->fill)
+		return 0;
+
+	ret = virtqueue_add_outbuf(out->vq, out->bufs[out->cur], out->fill);
+	if (ret)
+		return ret;
 
-	if (ret < 0)
-		return;
+	out->inflight++;
+	out->unkicked++;
+	out->fill = 0;
+	out->cur = (out->cur + 1) % VCON_NR_BUFS;
 
-	while (!virtqueue_get_buf(out_vq, &len))
-		;
+	if (out->unkicked >= VCON_BATCH)
+		vcon_kick(out);
+
+	/* the next buffer must be back from the device before reuse */
+	vcon_reclaim(out);
+	while (out->inflight == VCON_NR_BUFS) {
+		vcon_kick(out);
+		vcon_reclaim(out);
+	}
+	return 0;
+}
+
+static int vcon_write(struct vcon_out *out, const char *buf,
+		      unsigned int len)
+{
+	unsigned int n;
+	int ret;
+
+	while (len) {
+		n = MIN(len, VCON_BUF_SIZE - out->fill);
+		memcpy(out->bufs[out->cur] + out->fill, buf, n);
+		out->fill += n;
+		buf += n;
+		len -= n;
+		if (out->fill == VCON_BUF_SIZE) {
+			ret = vcon_submit(out);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static void vcon_flush(struct vcon_out *out)
+{
+	vcon_submit(out);
+	vcon_kick(out);
+	while (out->inflight)
+		vcon_reclaim(out);
+}
+
+int chr_testdev_puts(const char *s)
+{
+	int ret;
+
+	if (!console_out.vq)
+		return 0;
+
+	spin_lock(&lock);
+	ret = vcon_write(&console_out, s, strlen(s));
+	if (!ret && strchr(s, '\n'))
+		ret = vcon_submit(&console_out);
+	/* give up on the console, the caller reports it through its uart */
+	if (ret)
+		console_out.vq = NULL;
+	spin_unlock(&lock);
+	return ret ? ret : 1;
 }
 
 void chr_testdev_exit(int code)
 {
-	unsigned int len;
-	static char buf[8];
+	char buf[8];
 
 	spin_lock(&lock);
+	if (console_out.vq)
+		vcon_flush(&console_out);
 	if (!vcon)
 		goto out;
 
 	snprintf(buf, sizeof(buf), "%dq", code);
-	len = strlen(buf);
-
-	__testdev_send(buf, len);
+	vcon_write(&testdev_out, buf, strlen(buf));
+	vcon_flush(&testdev_out);
 
 out:
 	spin_unlock(&lock);
 }
 
-void chr_testdev_init(void)
+static struct virtio_device *vcon_init(struct virtqueue **in,
+				       struct virtqueue **out)
 {
 	const char *io_names[] = { "input", "output" };
+	struct virtio_device *dev;
 	struct virtqueue *vqs[2];
 	int ret;
 
-	vcon = virtio_bind(VIRTIO_ID_CONSOLE);
-	if (vcon == NULL) {
-		printf("%s: %s: can't find a virtio-console\n",
-				__func__, TESTDEV_NAME);
-		return;
-	}
+	dev = virtio_bind(VIRTIO_ID_CONSOLE);
+	if (dev == NULL)
+		return NULL;
 
-	ret = vcon->config->find_vqs(vcon, 2, vqs, NULL, io_names);
+	ret = dev->config->find_vqs(dev, 2, vqs, NULL, io_names);
 	if (ret < 0) {
 		printf("%s: %s: can't init virtqueues\n",
 				__func__, TESTDEV_NAME);
-		vcon = NULL;
-		return;
+		return NULL;
 	}
 
-	in_vq = vqs[0];
-	out_vq = vqs[1];
+	*in = vqs[0];
+	*out = vqs[1];
+	return dev;
+}
+
+static u32 vcon_max_nr_ports(struct virtio_device *dev)
+{
+	u32 max_nr_ports;
+
+	dev->config->get(dev, VCON_CONFIG_MAX_NR_PORTS,
+			 &max_nr_ports, sizeof(max_nr_ports));
+	return max_nr_ports;
+}
+
+void chr_testdev_init(void)
+{
+	struct virtio_device *dev;
+	struct virtqueue *in, *out;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		dev = vcon_init(&in, &out);
+		if (dev == NULL)
+			break;
+
+		if (vcon_max_nr_ports(dev) == 1 && !console_out.vq) {
+			console_out.vq = out;
+		} else if (!vcon) {
+			vcon = dev;
+			in_vq = in;
+			testdev_out.vq = out;
+		}
+	}
+
+	if (vcon == NULL)
+		printf("%s: %s: can't find a virtio-console\n",
+				__func__, TESTDEV_NAME);
 }
@@ -11,4 +11,14 @@
  */
 extern void chr_testdev_init(void);
 extern void chr_testdev_exit(int code);
+
+/*
+ * If a second, single port virtio-console is present, chr_testdev_puts()
+ * queues output to it and returns 1; it returns 0 if there is none and
+ * the caller should use its uart. Output is written out in batches of
+ * lines and on chr_testdev_exit(). If queueing fails, the console is
+ * dropped and chr_testdev_puts() returns the negative error; the caller
+ * should report that and write @s to its uart, like all later output.
+ */
+extern int chr_testdev_puts(const char *s);
 #endif
@@ -0,0 +1,129 @@
+/*
+ * Scalable spinlocks
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/barrier.h>
+#include "locks.h"
+
+#define READ_ONCE_U32(x)	(*(volatile unsigned int *)&(x))
+
+void ticket_lock(struct ticket_lock *lock)
+{
+	unsigned int ticket = __sync_fetch_and_add(&lock->next, 1);
+
+	while (READ_ONCE_U32(lock->owner) != ticket)
+		cpu_relax();
+	__sync_synchronize();
+}
+
+void ticket_unlock(struct ticket_lock *lock)
+{
+	__sync_fetch_and_add(&lock->owner, 1);
+}
+
+void mcs_lock(struct mcs_lock *lock, struct mcs_node *node)
+{
+	struct mcs_node *prev;
+
+	node->next = NULL;
+	node->locked = 0;
+	__sync_synchronize();
+	prev = __sync_lock_test_and_set(&lock->tail, node);
+	if (!prev)
+		return;
+
+	prev->next = node;
+	while (!node->locked)
+		cpu_relax();
+	__sync_synchronize();
+}
+
+void mcs_unlock(struct mcs_lock *lock, struct mcs_node *node)
+{
+	if (!node->next) {
+		if (__sync_bool_compare_and_swap(&lock->tail, node, NULL))
+			return;
+		/* A successor is between the exchange and linking itself. */
+		while (!node->next)
+			cpu_relax();
+	}
+	__sync_synchronize();
+	node->next->locked = 1;
+}
+
+/*
+ * The qspinlock word: bits 0-7 locked, bit 8 pending, bits 16-31 the
+ * queue tail as cpu + 1.
+ */
+#define Q_LOCKED	1u
+#define Q_LOCKED_MASK	0xffu
+#define Q_PENDING	(1u << 8)
+#define Q_TAIL_SHIFT	16
+#define Q_TAIL_MASK	(0xffffu << Q_TAIL_SHIFT)
+
+static struct mcs_node qspin_nodes[QSPIN_MAX_CPUS];
+
+void qspin_lock(struct qspinlock *lock, int cpu)
+{
+	struct mcs_node *node, *prev;
+	unsigned int val, old, tail;
+
+	if (__sync_bool_compare_and_swap(&lock->val, 0, Q_LOCKED))
+		return;
+
+	/*
+	 * Only the owner is there: become the pending waiter, which spins on
+	 * the lock word itself and does not need a queue node.
+	 */
+	if (!(READ_ONCE_U32(lock->val) & ~Q_LOCKED_MASK)) {
+		old = __sync_fetch_and_or(&lock->val, Q_PENDING);
+		if (!(old & ~Q_LOCKED_MASK)) {
+			while (READ_ONCE_U32(lock->val) & Q_LOCKED_MASK)
+				cpu_relax();
+			__sync_fetch_and_add(&lock->val, Q_LOCKED - Q_PENDING);
+			return;
+		}
+		if (!(old & Q_PENDING))
+			__sync_fetch_and_and(&lock->val, ~Q_PENDING);
+	}
+
+	assert(cpu >= 0 && cpu < QSPIN_MAX_CPUS);
+	node = &qspin_nodes[cpu];
+	node->next = NULL;
+	node->locked = 0;
+	tail = (unsigned int)(cpu + 1) << Q_TAIL_SHIFT;
+
+	do {
+		val = READ_ONCE_U32(lock->val);
+	} while (!__sync_bool_compare_and_swap(&lock->val, val,
+					       (val & ~Q_TAIL_MASK) | tail));
+
+	if (val & Q_TAIL_MASK) {
+		prev = &qspin_nodes[((val & Q_TAIL_MASK) >> Q_TAIL_SHIFT) - 1];
+		prev->next = node;
+		while (!node->locked)
+			cpu_relax();
+	}
+
+	/* Head of the queue: wait for both the owner and the pending waiter. */
+	while ((val = READ_ONCE_U32(lock->val)) & (Q_LOCKED_MASK | Q_PENDING))
+		cpu_relax();
+
+	/* Last in the queue, take the lock and clear the tail in one go. */
+	if ((val & Q_TAIL_MASK) == tail &&
+	    __sync_bool_compare_and_swap(&lock->val, val, Q_LOCKED))
+		return;
+
+	__sync_fetch_and_or(&lock->val, Q_LOCKED);
+	while (!node->next)
+		cpu_relax();
+	__sync_synchronize();
+	node->next->locked = 1;
+}
+
+void qspin_unlock(struct qspinlock *lock)
+{
+	__sync_fetch_and_and(&lock->val, ~Q_LOCKED_MASK);
+}
@@ -0,0 +1,51 @@
+#ifndef _LOCKS_H_
+#define _LOCKS_H_
+/*
+ * Scalable spinlocks
+ *
+ * The arch spinlocks are plain test-and-set locks: every waiter spins on
+ * the lock word and the winner is whoever gets the cache line next.  These
+ * are the alternatives:
+ *
+ * - ticket_lock: FIFO, but all waiters still spin on the same line.
+ * - mcs_lock: FIFO, every waiter spins on its own node; the caller
+ *   provides the node and must pass the same one to mcs_unlock().
+ * - qspinlock: a 32-bit lock word with an MCS queue behind it, as in
+ *   Linux.  One waiter spins on the lock word (pending), further ones
+ *   queue on per-CPU nodes.  @cpu must be unique per CPU and below
+ *   QSPIN_MAX_CPUS, and a CPU can wait for only one qspinlock at a time.
+ *
+ * All of them are made of __sync builtins, which are full barriers.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+
+#define QSPIN_MAX_CPUS	256
+
+struct ticket_lock {
+	unsigned int next;
+	unsigned int owner;
+};
+
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile int locked;
+} __attribute__((aligned(64)));
+
+struct mcs_lock {
+	struct mcs_node *tail;
+};
+
+struct qspinlock {
+	unsigned int val;
+};
+
+extern void ticket_lock(struct ticket_lock *lock);
+extern void ticket_unlock(struct ticket_lock *lock);
+extern void mcs_lock(struct mcs_lock *lock, struct mcs_node *node);
+extern void mcs_unlock(struct mcs_lock *lock, struct mcs_node *node);
+extern void qspin_lock(struct qspinlock *lock, int cpu);
+extern void qspin_unlock(struct qspinlock *lock);
+
+#endif /* _LOCKS_H_ */
@@ -0,0 +1,25 @@
+/*
+ * Migration from within a test, see migrate.h
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/barrier.h>
+#include "migrate.h"
+
+void migrate_poll(void (*poll)(void *data), void *data)
+{
+	puts("Now migrate the VM, then press a key to continue...\n");
+	while (__getchar() == -1) {
+		if (poll)
+			poll(data);
+		else
+			cpu_relax();
+	}
+	report_info("Migration complete");
+}
+
+void migrate(void)
+{
+	migrate_poll(NULL, NULL);
+}
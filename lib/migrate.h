@@ -0,0 +1,21 @@
+#ifndef _MIGRATE_H_
+#define _MIGRATE_H_
+/*
+ * Migration from within a test
+ *
+ * Tests in the "migration" group run under run_migration (see
+ * scripts/arch-run.bash), which waits for the word "migrate" in the
+ * test's output, migrates the guest, MIGRATE_ROUNDS times back and forth
+ * if that is set, and then sends a key to the guest.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+
+/* Asks for the guest to be migrated and returns once that is done. */
+extern void migrate(void);
+
+/* The same, calling @poll(@data) over and over while waiting. */
+extern void migrate_poll(void (*poll)(void *data), void *data);
+
+#endif
@@ -5,6 +5,15 @@
 
 extern int nr_threads;
 
+/* The Processor Identification Register holds the thread's id. */
+static inline int smp_processor_id(void)
+{
+	unsigned long pir;
+
+	asm volatile("mfspr %0,1023" : "=r" (pir));
+	return pir;
+}
+
 struct start_threads {
 	int nr_threads;
 	int nr_started;
@@ -12,47 +12,63 @@
 
 #include "libcflat.h"
 #include "asm/spinlock.h"
+#include "asm/smp.h"
 
-static unsigned int tests, failures, xfailures, skipped;
-static char prefixes[256];
+/*
+ * Counters and prefix stacks are per CPU, so CPUs only ever touch their
+ * own slot and reporting does not bounce a lock around; report_summary()
+ * adds the counters up. The lock only keeps output lines in one piece.
+ */
+#define REPORT_MAX_CPUS 512
+#define PREFIXES_SIZE 256
+
+struct report_cpu {
+	unsigned int tests, failures, xfailures, skipped;
+	char prefixes[PREFIXES_SIZE];
+} __attribute__((aligned(64)));
+
+static struct report_cpu report_cpus[REPORT_MAX_CPUS];
 static struct spinlock lock;
 
 #define PREFIX_DELIMITER ": "
 
+static struct report_cpu *this_report_cpu(void)
+{
+	int cpu = smp_processor_id();
+
+	assert_msg(cpu >= 0 && cpu < REPORT_MAX_CPUS, "CPU %d out of 0..%d",
+		   cpu, REPORT_MAX_CPUS - 1);
+	return &report_cpus[cpu];
+}
+
 void report_pass(void)
 {
-	spin_lock(&lock);
-	tests++;
-	spin_unlock(&lock);
+	this_report_cpu()->tests++;
 }
 
 void report_prefix_pushf(const char *prefix_fmt, ...)
 {
+	char *prefixes = this_report_cpu()->prefixes;
 	va_list va;
 	unsigned int len;
 	int start;
 
-	spin_lock(&lock);
-
 	len = strlen(prefixes);
-	assert_msg(len < sizeof(prefixes), "%d >= %zu", len, sizeof(prefixes));
+	assert_msg(len < PREFIXES_SIZE, "%d >= %d", len, PREFIXES_SIZE);
 	start = len;
 
 	va_start(va, prefix_fmt);
-	len += vsnprintf(&prefixes[len], sizeof(prefixes) - len, prefix_fmt,
-			 va);
+	len += vsnprintf(&prefixes[len], PREFIXES_SIZE - len, prefix_fmt, va);
 	va_end(va);
-	assert_msg(len < sizeof(prefixes), "%d >= %zu", len, sizeof(prefixes));
+	assert_msg(len < PREFIXES_SIZE, "%d >= %d", len, PREFIXES_SIZE);
 
 	assert_msg(!strstr(&prefixes[start], PREFIX_DELIMITER),
 		   "Prefix \"%s\" contains delimiter \"" PREFIX_DELIMITER "\"",
 		   &prefixes[start]);
 
-	len += snprintf(&prefixes[len], sizeof(prefixes) - len,
+	len += snprintf(&prefixes[len], PREFIXES_SIZE - len,
 			PREFIX_DELIMITER);
-	assert_msg(len < sizeof(prefixes), "%d >= %zu", len, sizeof(prefixes));
-
-	spin_unlock(&lock);
+	assert_msg(len < PREFIXES_SIZE, "%d >= %d", len, PREFIXES_SIZE);
 }
 
 void report_prefix_push(const char *prefix)
@@ -62,22 +78,17 @@ void report_prefix_push(const char *prefix)
 
 void report_prefix_pop(void)
 {
+	char *prefixes = this_report_cpu()->prefixes;
 	char *p, *q;
 
-	spin_lock(&lock);
-
-	if (!*prefixes) {
-		spin_unlock(&lock);
+	if (!*prefixes)
 		return;
-	}
 
 	for (p = prefixes, q = strstr(p, PREFIX_DELIMITER) + 2;
 			*q;
 			p = q, q = strstr(p, PREFIX_DELIMITER) + 2)
 		;
 	*p = '\0';
-
-	spin_unlock(&lock);
 }
 
 static void va_report(const char *msg_fmt,
@@ -86,21 +97,21 @@ static void va_report(const char *msg_fmt,
 	const char *prefix = skip ? "SKIP"
 				  : xfail ? (pass ? "XPASS" : "XFAIL")
 					  : (pass ? "PASS"  : "FAIL");
+	struct report_cpu *rc = this_report_cpu();
 
-	spin_lock(&lock);
-
-	tests++;
-	printf("%s: ", prefix);
-	puts(prefixes);
-	vprintf(msg_fmt, va);
-	puts("\n");
+	rc->tests++;
 	if (skip)
-		skipped++;
+		rc->skipped++;
 	else if (xfail && !pass)
-		xfailures++;
+		rc->xfailures++;
 	else if (xfail || !pass)
-		failures++;
+		rc->failures++;
 
+	spin_lock(&lock);
+	printf("%s: ", prefix);
+	puts(rc->prefixes);
+	vprintf(msg_fmt, va);
+	puts("\n");
 	spin_unlock(&lock);
 }
 
@@ -134,7 +145,7 @@ void report_info(const char *msg_fmt, ...)
 
 	spin_lock(&lock);
 	puts("INFO: ");
-	puts(prefixes);
+	puts(this_report_cpu()->prefixes);
 	va_start(va, msg_fmt);
 	vprintf(msg_fmt, va);
 	va_end(va);
@@ -144,7 +155,16 @@ void report_info(const char *msg_fmt, ...)
 
 int report_summary(void)
 {
-	int ret;
+	unsigned int tests = 0, failures = 0, xfailures = 0, skipped = 0;
+	int i, ret;
+
+	for (i = 0; i < REPORT_MAX_CPUS; i++) {
+		tests += report_cpus[i].tests;
+		failures += report_cpus[i].failures;
+		xfailures += report_cpus[i].xfailures;
+		skipped += report_cpus[i].skipped;
+	}
+
 	spin_lock(&lock);
 
 	printf("SUMMARY: %d tests", tests);
@@ -174,7 +194,7 @@ void report_abort(const char *msg_fmt, ...)
 
 	spin_lock(&lock);
 	puts("ABORT: ");
-	puts(prefixes);
+	puts(this_report_cpu()->prefixes);
 	va_start(va, msg_fmt);
 	vprintf(msg_fmt, va);
 	va_end(va);
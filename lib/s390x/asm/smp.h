@@ -0,0 +1,4 @@
+#ifndef _ASMS390X_SMP_H_
+#define _ASMS390X_SMP_H_
+#include "../smp.h"
+#endif
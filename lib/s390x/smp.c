@@ -201,6 +201,58 @@ out:
 	return rc;
 }
 
+static void (*on_cpus_func)(void *data);
+static void *on_cpus_data;
+static int on_cpus_pending;
+
+static void on_cpus_entry(void)
+{
+	on_cpus_func(on_cpus_data);
+	__sync_fetch_and_sub(&on_cpus_pending, 1);
+	for (;;)
+		mb();
+}
+
+/*
+ * Run func on all cpus, including the calling one, and wait until it has
+ * returned everywhere.  Cpus that are already running something else are
+ * skipped, the others are set up for the call and destroyed afterwards.
+ */
+void on_cpus(void (*func)(void *data), void *data)
+{
+	int i, num = smp_query_num_cpus();
+	uint16_t this_cpu = stap();
+	bool *started = calloc(num, sizeof(bool));
+	struct psw psw = {
+		.mask = extract_psw_mask(),
+		.addr = (unsigned long)on_cpus_entry,
+	};
+
+	on_cpus_func = func;
+	on_cpus_data = data;
+	on_cpus_pending = 0;
+	mb();
+
+	for (i = 0; i < num; i++) {
+		if (cpus[i].addr == this_cpu || cpus[i].active)
+			continue;
+		__sync_fetch_and_add(&on_cpus_pending, 1);
+		started[i] = !smp_cpu_setup(cpus[i].addr, psw);
+		if (!started[i])
+			__sync_fetch_and_sub(&on_cpus_pending, 1);
+	}
+
+	func(data);
+
+	while (*(volatile int *)&on_cpus_pending)
+		mb();
+
+	for (i = 0; i < num; i++)
+		if (started[i])
+			smp_cpu_destroy(cpus[i].addr);
+	free(started);
+}
+
 /*
  * Disregarding state, stop all cpus that once were online except for
  * calling cpu.
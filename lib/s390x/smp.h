@@ -37,6 +37,11 @@ struct cpu_status {
     uint64_t    crs[16];                        /* 0x0384 */
 };
 
+static inline int smp_processor_id(void)
+{
+	return stap();
+}
+
 int smp_query_num_cpus(void);
 struct cpu *smp_cpu_from_addr(uint16_t addr);
 bool smp_cpu_stopped(uint16_t addr);
@@ -48,6 +53,7 @@ int smp_cpu_stop_store_status(uint16_t addr);
 int smp_cpu_destroy(uint16_t addr);
 int smp_cpu_setup(uint16_t addr, struct psw psw);
 void smp_teardown(void);
+void on_cpus(void (*func)(void *data), void *data);
 void smp_setup(void);
 
 #endif
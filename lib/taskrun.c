@@ -0,0 +1,163 @@
+/*
+ * Work-stealing task runner
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/barrier.h>
+#include <asm/smp.h>
+#include <asm-generic/atomic.h>
+#include "taskrun.h"
+
+static struct task_worker workers[TASKRUN_MAX_WORKERS];
+static struct task submitted[TASKRUN_MAX_TASKS];
+static int nr_submitted, next_submitted;
+static int nr_workers;
+static int pending;
+
+void task_submit(task_fn fn, void *data)
+{
+	assert_msg(nr_submitted < TASKRUN_MAX_TASKS, "too many tasks");
+	submitted[nr_submitted].fn = fn;
+	submitted[nr_submitted].data = data;
+	nr_submitted++;
+}
+
+void task_spawn(struct task_worker *w, task_fn fn, void *data)
+{
+	spin_lock(&w->lock);
+	if (w->tail - w->head == TASKRUN_DEQUE_SIZE) {
+		spin_unlock(&w->lock);
+		w->stats.inline_run++;
+		fn(w, data);
+		return;
+	}
+	atomic_fetch_inc(&pending);
+	w->tasks[w->tail % TASKRUN_DEQUE_SIZE].fn = fn;
+	w->tasks[w->tail % TASKRUN_DEQUE_SIZE].data = data;
+	w->tail++;
+	spin_unlock(&w->lock);
+}
+
+static bool deque_pop(struct task_worker *w, struct task *t)
+{
+	bool found = false;
+
+	spin_lock(&w->lock);
+	if (w->tail != w->head) {
+		w->tail--;
+		*t = w->tasks[w->tail % TASKRUN_DEQUE_SIZE];
+		found = true;
+	}
+	spin_unlock(&w->lock);
+	return found;
+}
+
+static bool deque_steal(struct task_worker *victim, struct task *t)
+{
+	bool found = false;
+
+	/* Don't bother the owner with the lock if there is nothing to take. */
+	if (*(volatile unsigned int *)&victim->tail ==
+	    *(volatile unsigned int *)&victim->head)
+		return false;
+
+	spin_lock(&victim->lock);
+	if (victim->tail != victim->head) {
+		*t = victim->tasks[victim->head % TASKRUN_DEQUE_SIZE];
+		victim->head++;
+		found = true;
+	}
+	spin_unlock(&victim->lock);
+	return found;
+}
+
+static bool claim_submitted(struct task *t)
+{
+	int i;
+
+	if (*(volatile int *)&next_submitted >= nr_submitted)
+		return false;
+
+	i = atomic_fetch_inc(&next_submitted);
+	if (i >= nr_submitted)
+		return false;
+
+	*t = submitted[i];
+	return true;
+}
+
+static bool get_task(struct task_worker *w, struct task *t)
+{
+	int i, n = *(volatile int *)&nr_workers;
+
+	if (deque_pop(w, t))
+		return true;
+
+	if (claim_submitted(t)) {
+		w->stats.claimed++;
+		return true;
+	}
+
+	for (i = 1; i < n; i++) {
+		if (deque_steal(&workers[(w->id + i) % n], t)) {
+			w->stats.stolen++;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void worker(void *data)
+{
+	struct task_worker *w;
+	struct task t;
+	int id;
+
+	id = atomic_fetch_inc(&nr_workers);
+	assert_msg(id < TASKRUN_MAX_WORKERS, "too many workers");
+	w = &workers[id];
+	w->id = id;
+
+	while (*(volatile int *)&pending) {
+		if (!get_task(w, &t)) {
+			cpu_relax();
+			continue;
+		}
+		t.fn(w, t.data);
+		w->stats.run++;
+		atomic_fetch_dec(&pending);
+	}
+}
+
+int task_run(void)
+{
+	memset(workers, 0, sizeof(workers));
+	nr_workers = 0;
+	next_submitted = 0;
+	pending = nr_submitted;
+
+	on_cpus(worker, NULL);
+
+	nr_submitted = 0;
+	return nr_workers;
+}
+
+void task_print_stats(void)
+{
+	struct task_stats total = { 0 };
+	struct task_stats *s;
+	int i;
+
+	for (i = 0; i < nr_workers; i++) {
+		s = &workers[i].stats;
+		printf("worker %3d: %8lu run %8lu claimed %8lu stolen %8lu inline\n",
+		       i, s->run, s->claimed, s->stolen, s->inline_run);
+		total.run += s->run;
+		total.claimed += s->claimed;
+		total.stolen += s->stolen;
+		total.inline_run += s->inline_run;
+	}
+	printf("total     : %8lu run %8lu claimed %8lu stolen %8lu inline\n",
+	       total.run, total.claimed, total.stolen, total.inline_run);
+}
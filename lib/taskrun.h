@@ -0,0 +1,72 @@
+#ifndef _TASKRUN_H_
+#define _TASKRUN_H_
+/*
+ * Work-stealing task runner
+ *
+ * Spreads independent work items over all CPUs.  Tasks are queued with
+ * task_submit() and then executed by task_run(), which runs a worker on
+ * every CPU.  Each worker takes tasks from its own deque first, then from
+ * the submitted ones, and finally steals from the other workers.  A task
+ * can split its work by spawning further tasks on its own worker with
+ * task_spawn(); idle workers steal those, so the load stays balanced even
+ * when task sizes vary a lot.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/spinlock.h>
+
+#define TASKRUN_MAX_WORKERS	256
+#define TASKRUN_MAX_TASKS	4096
+#define TASKRUN_DEQUE_SIZE	64
+
+struct task_worker;
+typedef void (*task_fn)(struct task_worker *w, void *data);
+
+struct task {
+	task_fn fn;
+	void *data;
+};
+
+struct task_stats {
+	unsigned long run;	/* tasks executed by this worker */
+	unsigned long claimed;	/* taken from the submitted tasks */
+	unsigned long stolen;	/* taken from another worker's deque */
+	unsigned long inline_run; /* spawned with a full deque, run inline */
+};
+
+/*
+ * The owner pushes and pops at the tail, thieves take from the head.  The
+ * lock is only contended when somebody steals.
+ */
+struct task_worker {
+	struct spinlock lock;
+	unsigned int head, tail;
+	struct task tasks[TASKRUN_DEQUE_SIZE];
+	int id;
+	struct task_stats stats;
+} __attribute__((aligned(64)));
+
+/*
+ * task_submit queues a task for the next task_run().  It must not be
+ * called while task_run() is in progress, use task_spawn() from a task
+ * instead.
+ */
+extern void task_submit(task_fn fn, void *data);
+
+/*
+ * task_spawn queues a task on @w, the worker of the calling task.  The
+ * task is run directly if the worker's deque is full.
+ */
+extern void task_spawn(struct task_worker *w, task_fn fn, void *data);
+
+/*
+ * task_run executes all submitted tasks, and everything they spawn, on
+ * all CPUs.  Returns the number of workers once all tasks have finished.
+ */
+extern int task_run(void);
+
+/* task_print_stats prints the per-worker statistics of the last run. */
+extern void task_print_stats(void);
+
+#endif /* _TASKRUN_H_ */
@@ -17,3 +17,34 @@ int parse_keyval(char *s, long *val)
 	*val = atol(p+1);
 	return p - s;
 }
+
+static void sift_down(u64 *v, int i, int n)
+{
+	int child;
+	u64 x = v[i];
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n && v[child + 1] > v[child])
+			child++;
+		if (v[child] <= x)
+			break;
+		v[i] = v[child];
+		i = child;
+	}
+	v[i] = x;
+}
+
+void sort_u64(u64 *v, int n)
+{
+	int i;
+	u64 x;
+
+	for (i = n / 2 - 1; i >= 0; i--)
+		sift_down(v, i, n);
+	for (i = n - 1; i > 0; i--) {
+		x = v[0];
+		v[0] = v[i];
+		v[i] = x;
+		sift_down(v, 0, i);
+	}
+}
@@ -20,4 +20,10 @@
  */
 extern int parse_keyval(char *s, long *val);
 
+/*
+ * sort_u64 sorts @n values at @v in ascending order, e.g. latency
+ * samples before picking percentiles from them.
+ */
+extern void sort_u64(u64 *v, int n);
+
 #endif
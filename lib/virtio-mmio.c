@@ -115,11 +115,31 @@ static void vm_device_init(struct virtio_mmio_device *vm_dev)
  * virtio-mmio device tree support
  ******************************************************/
 
+/*
+ * QEMU's virt machine has 32 virtio-mmio transports. Remember the ones
+ * already handed out, so that binding the same device id again finds
+ * the next device.
+ */
+#define VM_MAX_BOUND	32
+static dt_pbus_addr_t vm_bound[VM_MAX_BOUND];
+static int vm_nr_bound;
+
 struct vm_dt_info {
 	u32 devid;
 	void *base;
+	dt_pbus_addr_t addr;
 };
 
+static bool vm_is_bound(dt_pbus_addr_t addr)
+{
+	int i;
+
+	for (i = 0; i < vm_nr_bound; ++i)
+		if (vm_bound[i] == addr)
+			return true;
+	return false;
+}
+
 static int vm_dt_match(const struct dt_device *dev, int fdtnode)
 {
 	struct vm_dt_info *info = (struct vm_dt_info *)dev->info;
@@ -131,7 +151,12 @@ static int vm_dt_match(const struct dt_device *dev, int fdtnode)
 
 	ret = dt_pbus_get_base(dev, &base);
 	assert(ret == 0);
+
+	if (vm_is_bound(base.addr))
+		return false;
+
 	info->base = ioremap(base.addr, base.size);
+	info->addr = base.addr;
 
 	magic = readl(info->base + VIRTIO_MMIO_MAGIC_VALUE);
 	if (magic != ('v' | 'i' << 8 | 'r' << 16 | 't' << 24))
@@ -164,6 +189,9 @@ static struct virtio_device *virtio_mmio_dt_bind(u32 devid)
 	if (node == -FDT_ERR_NOTFOUND)
 		return NULL;
 
+	assert(vm_nr_bound < VM_MAX_BOUND);
+	vm_bound[vm_nr_bound++] = info.addr;
+
 	vm_dev = calloc(1, sizeof(*vm_dev));
 	assert(vm_dev != NULL);
 
@@ -112,6 +112,9 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 
 	rmb();
 
+	if (vq->last_used_idx == vq->vring.used->idx)
+		return NULL;
+
 	last_used = (vq->last_used_idx & (vq->vring.num-1));
 	i = vq->vring.used->ring[last_used].id;
 	*len = vq->vring.used->ring[last_used].len;
@@ -0,0 +1,4 @@
+#ifndef _ASMX86_SMP_H_
+#define _ASMX86_SMP_H_
+#include "../smp.h"
+#endif
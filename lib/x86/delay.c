@@ -1,5 +1,10 @@
 #include "delay.h"
 #include "processor.h"
+#include "acpi.h"
+#include "asm/io.h"
+
+#define PM_TIMER_HZ	3579545
+#define PM_TIMER_MASK	0xffffff
 
 void delay(u64 count)
 {
@@ -9,3 +14,32 @@ void delay(u64 count)
 		pause();
 	} while (rdtsc() - start < count);
 }
+
+/*
+ * Calibrates the TSC against the 24-bit ACPI PM timer for 10ms.  Returns 0
+ * if there is no PM timer.  The result is cached after the first call.
+ */
+u64 tsc_khz(void)
+{
+	static u64 khz;
+	struct fadt_descriptor_rev1 *fadt;
+	u32 start, ticks;
+	u64 tsc;
+
+	if (khz)
+		return khz;
+
+	fadt = find_acpi_table_addr(FACP_SIGNATURE);
+	if (!fadt || !fadt->pm_tmr_blk)
+		return 0;
+
+	start = inl(fadt->pm_tmr_blk);
+	tsc = rdtsc();
+	do {
+		ticks = (inl(fadt->pm_tmr_blk) - start) & PM_TIMER_MASK;
+	} while (ticks < PM_TIMER_HZ / 100);
+	tsc = rdtsc() - tsc;
+
+	khz = tsc * PM_TIMER_HZ / ticks / 1000;
+	return khz;
+}
@@ -6,6 +6,7 @@
 #define IPI_DELAY 1000000
 
 void delay(u64 count);
+u64 tsc_khz(void);
 
 static inline void io_delay(void)
 {
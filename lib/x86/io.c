@@ -1,5 +1,6 @@
 #include "libcflat.h"
 #include "smp.h"
+#include "processor.h"
 #include "asm/io.h"
 #include "asm/page.h"
 #include "vmalloc.h"
@@ -10,24 +11,34 @@
 static struct spinlock lock;
 static int serial_iobase = 0x3f8;
 static int serial_inited = 0;
-
-static void serial_outb(char ch)
+static int serial_burst = 1;
+
+/*
+ * Each puts() is collected here and written out in one go, so that the
+ * UART is only polled once per FIFO worth of characters instead of once
+ * per character.  Nothing is left in the buffer between calls, so output
+ * is not lost when the guest hangs or dies.  The buffer is global, under
+ * the console lock, rather than per CPU: puts() also runs with %gs
+ * loaded with a flat selector, e.g. from taskswitch2's interrupt tasks,
+ * where the per-CPU area cannot be reached.
+ */
+static char out_buf[1024];
+static unsigned long out_len;
+
+static void serial_write(const char *buf, unsigned long len)
 {
-        u8 lsr;
-
-        do {
-                lsr = inb(serial_iobase + 0x05);
-        } while (!(lsr & 0x20));
+        unsigned long n;
 
-        outb(ch, serial_iobase + 0x00);
-}
+        while (len) {
+                /* With the FIFO enabled, THRE means the FIFO is empty. */
+                while (!(inb(serial_iobase + 0x05) & 0x20))
+                        ;
 
-static void serial_put(char ch)
-{
-        /* Force carriage return to be performed on \n */
-        if (ch == '\n')
-                serial_outb('\r');
-        serial_outb(ch);
+                n = MIN(len, serial_burst);
+                len -= n;
+                asm volatile ("rep/outsb" : "+S"(buf), "+c"(n)
+                              : "d"(serial_iobase));
+        }
 }
 
 static void serial_init(void)
@@ -52,28 +63,48 @@ static void serial_init(void)
         outb(0x00, serial_iobase + 0x01);
         /* LCR: 8 bits, no parity, one stop bit */
         outb(0x03, serial_iobase + 0x03);
-        /* FCR: disable FIFO queues */
-        outb(0x00, serial_iobase + 0x02);
+        /* FCR: enable and clear the FIFO queues */
+        outb(0x07, serial_iobase + 0x02);
+        /* IIR: a 16550A reports working 16 byte FIFOs */
+        if ((inb(serial_iobase + 0x02) & 0xc0) == 0xc0)
+                serial_burst = 16;
         /* MCR: RTS, DTR on */
         outb(0x03, serial_iobase + 0x04);
 }
 
-static void print_serial(const char *buf)
+static void flush_serial(void)
 {
-	unsigned long len = strlen(buf);
 #ifdef USE_SERIAL
-        unsigned long i;
         if (!serial_inited) {
             serial_init();
             serial_inited = 1;
         }
 
-        for (i = 0; i < len; i++) {
-            serial_put(buf[i]);
-        }
+        serial_write(out_buf, out_len);
 #else
+        const char *buf = out_buf;
+        unsigned long len = out_len;
+
         asm volatile ("rep/outsb" : "+S"(buf), "+c"(len) : "d"(0xf1));
 #endif
+        out_len = 0;
+}
+
+static void print_serial(const char *buf)
+{
+        for (; *buf; buf++) {
+            if (out_len > sizeof(out_buf) - 2)
+                flush_serial();
+#ifdef USE_SERIAL
+            /* Force carriage return to be performed on \n */
+            if (*buf == '\n')
+                out_buf[out_len++] = '\r';
+#endif
+            out_buf[out_len++] = *buf;
+        }
+
+        if (out_len)
+            flush_serial();
 }
 
 void puts(const char *s)
@@ -83,8 +114,36 @@ void puts(const char *s)
 	spin_unlock(&lock);
 }
 
+int __getchar(void)
+{
+	int c = -1;
+
+	spin_lock(&lock);
+	if (!serial_inited) {
+		serial_init();
+		serial_inited = 1;
+	}
+	/* LSR: data ready */
+	if (inb(serial_iobase + 0x05) & 0x01)
+		c = inb(serial_iobase + 0x00);
+	spin_unlock(&lock);
+	return c;
+}
+
 void exit(int code)
 {
+	int tries;
+
+	/*
+	 * Let another CPU finish the line it is writing, but don't wait
+	 * forever for one that died holding the lock.
+	 */
+	for (tries = 0; tries < 1000000; tries++) {
+		if (!__sync_lock_test_and_set(&lock.v, 1))
+			break;
+		pause();
+	}
+
 #ifdef USE_SERIAL
         static const char shutdown_str[8] = "Shutdown";
         int i;
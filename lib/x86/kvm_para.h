@@ -0,0 +1,52 @@
+#ifndef __X86_KVM_PARA_H
+#define __X86_KVM_PARA_H
+
+#include "libcflat.h"
+#include "processor.h"
+
+#define KVM_CPUID_SIGNATURE		0x40000000
+#define KVM_CPUID_FEATURES		0x40000001
+
+#define KVM_FEATURE_PV_UNHALT		7
+#define KVM_FEATURE_PV_SEND_IPI		11
+
+#define KVM_HC_KICK_CPU			5
+#define KVM_HC_SEND_IPI			10
+
+static inline bool kvm_para_available(void)
+{
+	struct cpuid c = raw_cpuid(KVM_CPUID_SIGNATURE, 0);
+
+	return c.b == 0x4b4d564b && c.c == 0x564b4d56 && c.d == 0x4d;
+}
+
+static inline bool kvm_para_has_feature(unsigned int feature)
+{
+	return kvm_para_available() &&
+	       (raw_cpuid(KVM_CPUID_FEATURES, 0).a & (1u << feature));
+}
+
+/* KVM patches vmcall into vmmcall on AMD hosts. */
+static inline long kvm_hypercall2(unsigned int nr, unsigned long a0,
+				  unsigned long a1)
+{
+	long ret;
+
+	asm volatile("vmcall" : "=a"(ret) : "a"(nr), "b"(a0), "c"(a1)
+		     : "memory");
+	return ret;
+}
+
+static inline long kvm_hypercall4(unsigned int nr, unsigned long a0,
+				  unsigned long a1, unsigned long a2,
+				  unsigned long a3)
+{
+	long ret;
+
+	asm volatile("vmcall" : "=a"(ret)
+		     : "a"(nr), "b"(a0), "c"(a1), "d"(a2), "S"(a3)
+		     : "memory");
+	return ret;
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Guest view of migration downtime, see migrate_pause.h
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "asm/io.h"
+#include "delay.h"
+#include "migrate.h"
+#include "migrate_pause.h"
+
+#define RTC_SECONDS	0x00
+#define RTC_MINUTES	0x02
+#define RTC_HOURS	0x04
+#define RTC_REG_A	0x0a
+#define RTC_REG_B	0x0b
+
+#define RTC_UIP		0x80	/* register A: update in progress */
+#define RTC_DM_BINARY	0x04	/* register B: binary, not BCD */
+
+static u8 cmos_read(u8 reg)
+{
+	outb(reg, 0x70);
+	return inb(0x71);
+}
+
+static u32 rtc_field(u8 reg)
+{
+	u8 v = cmos_read(reg);
+
+	if (cmos_read(RTC_REG_B) & RTC_DM_BINARY)
+		return v;
+	return (v >> 4) * 10 + (v & 0xf);
+}
+
+/* Seconds since midnight; QEMU's RTC runs in 24 hour mode. */
+static u32 rtc_time_of_day(void)
+{
+	u32 t;
+
+	do {
+		while (cmos_read(RTC_REG_A) & RTC_UIP)
+			;
+		t = rtc_field(RTC_HOURS) * 3600 + rtc_field(RTC_MINUTES) * 60 +
+		    rtc_field(RTC_SECONDS);
+	} while (rtc_field(RTC_SECONDS) != t % 60);
+	return t;
+}
+
+/* Waits for the RTC seconds to tick over, returns the TSC at that point. */
+static u64 rtc_edge(u32 *t)
+{
+	u8 sec = cmos_read(RTC_SECONDS);
+	u64 tsc;
+
+	while (cmos_read(RTC_SECONDS) == sec)
+		;
+	tsc = rdtsc();
+	*t = rtc_time_of_day();
+	return tsc;
+}
+
+struct stall {
+	u64 last;
+	u64 max;
+};
+
+static void track_stall(void *data)
+{
+	struct stall *s = data;
+	u64 now = rdtsc();
+
+	if (now - s->last > s->max)
+		s->max = now - s->last;
+	s->last = now;
+}
+
+bool migrate_measure_pause(struct migrate_pause *p)
+{
+	u64 khz = tsc_khz();
+	struct stall stall;
+	u64 tsc0, tsc1;
+	u32 t0, t1;
+
+	memset(p, 0, sizeof(*p));
+	if (!khz) {
+		migrate();
+		return false;
+	}
+
+	tsc0 = rtc_edge(&t0);
+	stall.last = tsc0;
+	stall.max = 0;
+	migrate_poll(track_stall, &stall);
+	tsc1 = rtc_edge(&t1);
+
+	if (t1 < t0)
+		t1 += 24 * 3600;
+	p->wall_us = (u64)(t1 - t0) * 1000000;
+	p->guest_us = (tsc1 - tsc0) * 1000 / khz;
+	p->hidden_us = p->wall_us > p->guest_us ? p->wall_us - p->guest_us : 0;
+	p->max_stall_us = stall.max * 1000 / khz;
+	return true;
+}
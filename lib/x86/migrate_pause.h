@@ -0,0 +1,30 @@
+#ifndef _X86_MIGRATE_PAUSE_H_
+#define _X86_MIGRATE_PAUSE_H_
+/*
+ * How long a migration paused the guest, seen from the guest
+ *
+ * QEMU stops the TSC and kvmclock along with the vCPUs and restores them
+ * on the destination, so most of the downtime never shows up in the
+ * guest's own clocks; the CMOS RTC follows the host's wall clock though.
+ * migrate_measure_pause() migrates like migrate() and compares the TSC
+ * with the RTC over the migration, both read right at an RTC second
+ * boundary so that the one second resolution of the RTC drops out. It
+ * also records the longest gap between two TSC reads while waiting, the
+ * part of a pause the guest does see (e.g. with a TSC that is not
+ * migrated, or vCPUs stalled on dirty page tracking).
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+
+struct migrate_pause {
+	u64 wall_us;		/* RTC time from start to end */
+	u64 guest_us;		/* TSC time over the same period */
+	u64 hidden_us;		/* wall_us - guest_us */
+	u64 max_stall_us;	/* longest gap between two TSC reads */
+};
+
+/* Returns false, migrating anyway, if the TSC frequency is unknown. */
+extern bool migrate_measure_pause(struct migrate_pause *p);
+
+#endif
@@ -11,28 +11,45 @@
 
 typedef void (*ipi_function_type)(void *data);
 
-static struct spinlock ipi_lock;
-static volatile ipi_function_type ipi_function;
-static void *volatile ipi_data;
-static volatile int ipi_done;
-static volatile bool ipi_wait;
+/*
+ * Each CPU has its own call mailbox, indexed by APIC id.  A sender posts
+ * function/data and then sets ->function; the target clears ->function
+ * once the mailbox may be reused, i.e. on entry for asynchronous calls and
+ * after the call for synchronous ones.  The lock serializes senders that
+ * target the same CPU.
+ */
+struct ipi_mailbox {
+    struct spinlock lock;
+    ipi_function_type volatile function;
+    void *volatile data;
+    volatile bool wait;
+} __attribute__((aligned(64)));
+
+static struct ipi_mailbox mailboxes[MAX_TEST_CPUS];
 static int _cpu_count;
 static atomic_t active_cpus;
 
 static __attribute__((used)) void ipi(void)
 {
-    void (*function)(void *data) = ipi_function;
-    void *data = ipi_data;
-    bool wait = ipi_wait;
+    struct ipi_mailbox *mbox = &mailboxes[smp_id()];
+    void (*function)(void *data) = mbox->function;
+    void *data = mbox->data;
+    bool wait = mbox->wait;
+
+    /* Broadcasts also reach CPUs that have nothing posted. */
+    if (!function) {
+	apic_write(APIC_EOI, 0);
+	return;
+    }
 
     if (!wait) {
-	ipi_done = 1;
+	mbox->function = NULL;
 	apic_write(APIC_EOI, 0);
     }
     function(data);
     atomic_dec(&active_cpus);
     if (wait) {
-	ipi_done = 1;
+	mbox->function = NULL;
 	apic_write(APIC_EOI, 0);
     }
 }
@@ -60,31 +77,39 @@ int smp_id(void)
     return id;
 }
 
-static void setup_smp_id(void *data)
+/* Called with mbox->lock held, returns once the call has been posted. */
+static void post_call(struct ipi_mailbox *mbox, void (*function)(void *data),
+		      void *data, bool wait)
 {
-    asm ("mov %0, %%gs:0" : : "r"(apic_id()) : "memory");
+    while (mbox->function)
+	pause();
+
+    atomic_inc(&active_cpus);
+    mbox->data = data;
+    mbox->wait = wait;
+    barrier();
+    mbox->function = function;
 }
 
 static void __on_cpu(int cpu, void (*function)(void *data), void *data,
                      int wait)
 {
     unsigned int target = id_map[cpu];
+    struct ipi_mailbox *mbox = &mailboxes[target];
 
-    spin_lock(&ipi_lock);
-    if (target == smp_id())
+    if (target == smp_id()) {
 	function(data);
-    else {
-	atomic_inc(&active_cpus);
-	ipi_done = 0;
-	ipi_function = function;
-	ipi_data = data;
-	ipi_wait = wait;
-	apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED
-                       | IPI_VECTOR, target);
-	while (!ipi_done)
-	    ;
+	return;
     }
-    spin_unlock(&ipi_lock);
+
+    spin_lock(&mbox->lock);
+    post_call(mbox, function, data, wait);
+    apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED
+                   | IPI_VECTOR, target);
+    if (wait)
+	while (mbox->function)
+	    pause();
+    spin_unlock(&mbox->lock);
 }
 
 void on_cpu(int cpu, void (*function)(void *data), void *data)
@@ -97,12 +122,29 @@ void on_cpu_async(int cpu, void (*function)(void *data), void *data)
     __on_cpu(cpu, function, data, 0);
 }
 
+/*
+ * Post the call to every other CPU's mailbox and kick them all with a
+ * single "all excluding self" IPI, so that all CPUs start at about the
+ * same time no matter how many there are.
+ */
 void on_cpus(void (*function)(void *data), void *data)
 {
+    unsigned int self = smp_id();
+    struct ipi_mailbox *mbox;
     int cpu;
 
-    for (cpu = cpu_count() - 1; cpu >= 0; --cpu)
-        on_cpu_async(cpu, function, data);
+    for (cpu = 0; cpu < cpu_count(); ++cpu) {
+	if (id_map[cpu] == self)
+	    continue;
+	mbox = &mailboxes[id_map[cpu]];
+	spin_lock(&mbox->lock);
+	post_call(mbox, function, data, false);
+	spin_unlock(&mbox->lock);
+    }
+
+    apic_icr_write(APIC_INT_ASSERT | APIC_DEST_ALLBUT | APIC_DEST_PHYSICAL
+                   | APIC_DM_FIXED | IPI_VECTOR, 0);
+    function(data);
 
     while (cpus_active() > 1)
         pause();
@@ -115,7 +157,6 @@ int cpus_active(void)
 
 void smp_init(void)
 {
-    int i;
     void ipi_entry(void);
 
     _cpu_count = fwcfg_get_nb_cpus();
@@ -124,9 +165,5 @@ void smp_init(void)
     init_apic_map();
     set_idt_entry(IPI_VECTOR, ipi_entry, 0);
 
-    setup_smp_id(0);
-    for (i = 1; i < cpu_count(); ++i)
-        on_cpu(i, setup_smp_id, 0);
-
     atomic_inc(&active_cpus);
 }
@@ -6,9 +6,45 @@ void smp_init(void);
 
 int cpu_count(void);
 int smp_id(void);
+#define smp_processor_id()	smp_id()
 int cpus_active(void);
 void on_cpu(int cpu, void (*function)(void *data), void *data);
 void on_cpu_async(int cpu, void (*function)(void *data), void *data);
 void on_cpus(void (*function)(void *data), void *data);
 
+/*
+ * Per-CPU variables live in .data.percpu.  At boot every CPU gets its own
+ * copy of the section, indexed by APIC id and cache line aligned, and %gs
+ * points to it; %gs:0 holds smp_id() and %gs:8 the address of the copy.
+ * The variable itself is only the initial value for all copies and must
+ * not be accessed directly, go through this_cpu() or per_cpu() instead.
+ */
+#define DEFINE_PER_CPU(type, name) \
+	__attribute__((section(".data.percpu"))) __typeof__(type) name
+#define DECLARE_PER_CPU(type, name) \
+	extern __typeof__(type) name
+
+extern char __percpu_start[], __percpu_end[], __percpu_areas[];
+
+static inline void *this_cpu_area(void)
+{
+	void *area;
+
+	asm ("mov %%gs:8, %0" : "=r"(area));
+	return area;
+}
+
+static inline void *per_cpu_area(int id)
+{
+	return __percpu_areas + id * (__percpu_end - __percpu_start);
+}
+
+#define __percpu_offset(var)	((char *)&(var) - __percpu_start)
+#define this_cpu_ptr(var) \
+	((__typeof__(var) *)(this_cpu_area() + __percpu_offset(var)))
+#define per_cpu_ptr(var, id) \
+	((__typeof__(var) *)(per_cpu_area(id) + __percpu_offset(var)))
+#define this_cpu(var)		(*this_cpu_ptr(var))
+#define per_cpu(var, id)	(*per_cpu_ptr(var, id))
+
 #endif
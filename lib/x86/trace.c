@@ -0,0 +1,110 @@
+#include "libcflat.h"
+#include "alloc.h"
+#include "apic.h"
+#include "delay.h"
+#include "trace.h"
+
+DEFINE_PER_CPU(struct trace_buf *, trace_buf);
+bool trace_mark_enabled;
+
+static u64 next[MAX_TEST_CPUS];
+
+/*
+ * nr_records per CPU, rounded up to a power of two; with 0 there are no
+ * rings and only trace_mark()'s hypercalls.
+ */
+void trace_init(unsigned int nr_records)
+{
+	struct trace_buf *buf;
+	unsigned int size = 1;
+	int i;
+
+	trace_mark_enabled = kvm_para_available();
+	if (!nr_records)
+		return;
+
+	while (size < nr_records)
+		size <<= 1;
+
+	for (i = 0; i < cpu_count(); i++) {
+		buf = calloc(1, sizeof(*buf) + size * sizeof(struct trace_rec));
+		assert(buf);
+		buf->mask = size - 1;
+		per_cpu(trace_buf, id_map[i]) = buf;
+	}
+}
+
+void trace_reset(void)
+{
+	int i;
+
+	for (i = 0; i < cpu_count(); i++)
+		if (per_cpu(trace_buf, id_map[i]))
+			per_cpu(trace_buf, id_map[i])->head = 0;
+}
+
+static struct trace_rec *next_rec(int i)
+{
+	struct trace_buf *buf = per_cpu(trace_buf, id_map[i]);
+
+	if (next[i] == buf->head)
+		return NULL;
+	return &buf->recs[next[i] & buf->mask];
+}
+
+/*
+ * Prints one line per record, oldest first:
+ *
+ *   TRACE <us since the first record> cpu <n> <event> <arg0> <arg1>
+ *
+ * with <n> the CPU index, not the APIC id.  Events are printed as
+ * names[event] if there is one, as numbers otherwise.  If the TSC
+ * frequency is unknown, times are in kilocycles instead.
+ */
+void trace_dump(const char *const *names, unsigned int nr_names)
+{
+	struct trace_buf *buf;
+	struct trace_rec *rec, *r;
+	u64 khz = tsc_khz(), first = 0, ns, lost = 0;
+	int i, cpu = 0;
+
+	if (!this_cpu(trace_buf))
+		return;
+
+	for (i = 0; i < cpu_count(); i++) {
+		buf = per_cpu(trace_buf, id_map[i]);
+		next[i] = 0;
+		if (buf->head > buf->mask + 1) {
+			next[i] = buf->head - (buf->mask + 1);
+			lost += next[i];
+		}
+	}
+
+	printf("TRACE: %d cpus, TSC %ld kHz%s, %ld records overwritten\n",
+	       cpu_count(), khz, khz ? "" : " (unknown)", lost);
+
+	for (;;) {
+		rec = NULL;
+		for (i = 0; i < cpu_count(); i++) {
+			r = next_rec(i);
+			if (r && (!rec || r->tsc < rec->tsc)) {
+				rec = r;
+				cpu = i;
+			}
+		}
+		if (!rec)
+			break;
+		next[cpu]++;
+
+		if (!first)
+			first = rec->tsc;
+		ns = khz ? (rec->tsc - first) * 1000000 / khz : rec->tsc - first;
+
+		printf("TRACE %8ld.%03ld cpu %3d ", ns / 1000, ns % 1000, cpu);
+		if (rec->event < nr_names && names[rec->event])
+			printf("%-16s", names[rec->event]);
+		else
+			printf("%-16d", rec->event);
+		printf(" %#lx %#lx\n", rec->arg[0], rec->arg[1]);
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef __X86_TRACE_H
+#define __X86_TRACE_H
+/*
+ * In-guest binary tracing
+ *
+ * trace() appends a fixed-size record, the TSC plus an event id and two
+ * arguments, to the calling CPU's ring buffer.  That is a %gs relative
+ * load, RDTSC and a few stores: no exit, no lock, cheap enough for
+ * interrupt handlers and timing loops where printf() would skew the
+ * result.  A full ring overwrites its oldest records.  trace_dump()
+ * merges all CPUs' records by TSC and prints them, once the measurement
+ * is over and nobody traces anymore.
+ *
+ * trace_init() allocates the rings and must run after setup_vm() and
+ * smp_init(); until then trace() does nothing.
+ *
+ * trace_mark() is for lining guest events up with a host trace: besides
+ * tracing locally it makes a hypercall that KVM fails right away, but
+ * not before the host's kvm_hypercall trace event has recorded
+ *
+ *   nr TRACE_MARK_HC, a0 the event, a1 the guest TSC, a2 the argument.
+ *
+ * That costs one exit.  scripts/trace_align.py uses the guest TSCs to
+ * place the markers in a host trace taken with the x86-tsc trace clock.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "smp.h"
+#include "kvm_para.h"
+
+#define TRACE_MARK_HC	0x6b7574	/* "kut" */
+
+struct trace_rec {
+	u64 tsc;
+	u32 event;
+	u32 reserved;
+	u64 arg[2];
+};
+
+struct trace_buf {
+	u64 head;
+	u64 mask;
+	struct trace_rec recs[];
+};
+
+DECLARE_PER_CPU(struct trace_buf *, trace_buf);
+
+static inline void trace(u32 event, u64 arg0, u64 arg1)
+{
+	struct trace_buf *buf = this_cpu(trace_buf);
+	struct trace_rec *rec;
+	u64 head = 1;
+
+	if (!buf)
+		return;
+
+	/* One instruction, so an interrupt handler tracing too is fine. */
+	asm volatile("xadd %0, %1" : "+r"(head), "+m"(buf->head));
+	rec = &buf->recs[head & buf->mask];
+	rec->tsc = rdtsc();
+	rec->event = event;
+	rec->arg[0] = arg0;
+	rec->arg[1] = arg1;
+}
+
+extern bool trace_mark_enabled;
+
+static inline void trace_mark(u32 event, u64 arg)
+{
+	trace(event, arg, 0);
+	if (trace_mark_enabled)
+		kvm_hypercall4(TRACE_MARK_HC, event, rdtsc(), arg, 0);
+}
+
+void trace_init(unsigned int nr_records);
+void trace_reset(void);
+void trace_dump(const char *const *names, unsigned int nr_names);
+
+#endif
@@ -3,6 +3,10 @@
 verbose="no"
 tap_output="no"
 run_all_tests="no" # don't run nodefault tests
+pin_tasks="no"
+baseline=""
+repeat=1
+slower_threshold=20
 
 if [ ! -f config.mak ]; then
     echo "run ./configure && make first. See ./configure -h"
@@ -10,12 +14,14 @@ if [ ! -f config.mak ]; then
 fi
 source config.mak
 source scripts/common.bash
+source scripts/arch-run.bash
 
 function usage()
 {
 cat <<EOF
 
-Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t]
+Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-k] [-p] [-r COUNT] [-t]
+          [-b DURATIONS [--slower PERCENT]]
 
     -h, --help      Output this help text
     -v, --verbose   Enables verbose mode
@@ -23,11 +29,32 @@ Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t]
                     and those guarded by errata.
     -g, --group     Only execute tests in the given group
     -j, --parallel  Execute tests in parallel
+    -k, --kvm-stat  Count KVM exits and some of their causes with perf
+                    stat; the total goes to the result line, the details
+                    to the test's log
+    -p, --pin       Pin each test to its own set of host CPUs
+    -r, --repeat    Run each test COUNT times, each in a fresh QEMU, and
+                    aggregate the numbers it prints, see
+                    scripts/aggregate-metrics.awk
     -t, --tap13     Output test results in TAP format
+    -b, --baseline  Compare test durations with a previous run's, e.g.
+                    logs.old/durations, and the numbers tests printed
+                    with the .metrics files next to it
+        --slower    Flag tests more than PERCENT slower than in the
+                    baseline, and numbers that moved by more than
+                    PERCENT (default 20)
 
 Set the environment variable QEMU=/path/to/qemu-system-ARCH to
 specify the appropriate qemu binary for ARCH-run.
 
+Parallel tests are packed so that their vCPUs don't add up to more than
+the host CPUs the script may run on (see taskset(1)); tests in the
+'perf' group always run on their own.
+
+Each test's wall time in milliseconds goes to the durations file in the
+logs directory, and the numbers the test printed to <test>.metrics next
+to its log.
+
 EOF
 }
 
@@ -35,7 +62,7 @@ RUNTIME_arch_run="./$TEST_DIR/run"
 source scripts/runtime.bash
 
 only_tests=""
-args=`getopt -u -o ag:htj:v -l all,group:,help,tap13,parallel:,verbose -- $*`
+args=`getopt -u -o ab:g:htj:kpr:v -l all,baseline:,group:,help,tap13,parallel:,kvm-stat,pin,repeat:,slower:,verbose -- $*`
 [ $? -ne 0 ] && exit 2;
 set -- $args;
 while [ $# -gt 0 ]; do
@@ -44,6 +71,10 @@ while [ $# -gt 0 ]; do
             run_all_tests="yes"
             export ERRATA_FORCE=y
             ;;
+        -b | --baseline)
+            shift
+            baseline=$1
+            ;;
         -g | --group)
             shift
             only_group=$1
@@ -60,6 +91,24 @@ while [ $# -gt 0 ]; do
                 exit 2
             fi
             ;;
+        -k | --kvm-stat)
+            RUNTIME_kvm_stat="yes"
+            ;;
+        -p | --pin)
+            pin_tasks="yes"
+            ;;
+        -r | --repeat)
+            shift
+            repeat=$1
+            if (( $repeat <= 0 )); then
+                echo "Invalid -r option: $repeat"
+                exit 2
+            fi
+            ;;
+        --slower)
+            shift
+            slower_threshold=$1
+            ;;
         -v | --verbose)
             verbose="yes"
             ;;
@@ -75,6 +124,25 @@ while [ $# -gt 0 ]; do
     shift
 done
 
+# find out once rather than have every test complain
+if [ "$RUNTIME_kvm_stat" = "yes" ] && ! kvm_stat_usable; then
+    echo "perf cannot count kvm events here (see perf_event_paranoid), ignoring -k"
+    RUNTIME_kvm_stat="no"
+fi
+
+# "<test>\t<line>" for every line of the given .metrics files
+function metrics_lines()
+{
+    awk '{ t = FILENAME; sub(/.*\//, "", t); sub(/\.metrics$/, "", t)
+           print t "\t" $0 }' "$@" 2>/dev/null
+}
+
+# read it now, it might be in the logs directory that is about to move
+if [ -n "$baseline" ]; then
+    baseline_durations=$(<"$baseline") || exit 2
+    baseline_metrics=$(metrics_lines $(dirname "$baseline")/*.metrics)
+fi
+
 # RUNTIME_log_file will be configured later
 if [[ $tap_output == "no" ]]; then
     process_test_output() { cat >> $RUNTIME_log_file; }
@@ -123,23 +191,140 @@ RUNTIME_log_stdout () {
     fi
 }
 
+# The host CPUs we may use, e.g. "0-3,6" -> "0 1 2 3 6"
+function get_host_cpus()
+{
+	local list range
+
+	list=$(taskset -pc $$ 2>/dev/null) || {
+		seq 0 $(($(getconf _NPROCESSORS_ONLN) - 1))
+		return
+	}
+	list=${list##*: }
+	for range in ${list//,/ }; do
+		seq ${range%-*} ${range#*-}
+	done
+}
+
+host_cpus=( $(get_host_cpus) )
+free_cpus=( "${host_cpus[@]}" )
+cpus_used=0
+declare -A task_smp task_cpus
+
+# Give the CPUs of finished background tests back
+function reap_tasks()
+{
+	local pid
+
+	for pid in "${!task_smp[@]}"; do
+		kill -0 $pid 2>/dev/null && continue
+		cpus_used=$((cpus_used - task_smp[$pid]))
+		free_cpus+=( ${task_cpus[$pid]} )
+		unset task_smp[$pid] task_cpus[$pid]
+	done
+}
+
+# Run a test $repeat times in a row, logging each run on its own
+function run_repeated()
+{
+	local i ret=0
+
+	if (( repeat == 1 )); then
+		run "$@"
+		return
+	fi
+
+	for (( i = 1; i <= repeat; i++ )); do
+		RUNTIME_log_file="${unittest_log_dir}/$1.$i.log"
+		run "$@"
+		ret=$?
+		# skipped or filtered out, no need to ask again
+		if [ $ret -eq 2 ] || [ $ret -eq 77 ] ||
+		   [ ! -e "$RUNTIME_log_file" ]; then
+			break
+		fi
+	done
+	return $ret
+}
+
+# Whether run() is going to start the test, rather than filter it out or
+# skip it for its groups, arch or check
+function will_run()
+{
+	local testname="$1"
+	local groups="$2"
+	local arch="$6"
+	local check="${CHECK:-$7}"
+	local check_param
+
+	if [ -n "$only_tests" ] && ! grep -qw "$testname" <<<$only_tests; then
+		return 1
+	fi
+	if [ -n "$only_group" ] && ! grep -qw "$only_group" <<<$groups; then
+		return 1
+	fi
+	if [ -z "$only_group" ] && [ "$run_all_tests" != "yes" ] &&
+	   grep -qw "nodefault" <<<$groups; then
+		return 1
+	fi
+	if [ -n "$arch" ] && [ "$arch" != "$ARCH" ]; then
+		return 1
+	fi
+	for check_param in "${check[@]}"; do
+		if [ "${check_param%%=*}" ] &&
+		   [ "$(cat ${check_param%%=*})" != "${check_param#*=}" ]; then
+			return 1
+		fi
+	done
+}
+
 function run_task()
 {
 	local testname="$1"
+	local groups="$2"
+	local smp exclusive="no"
+	local cpus=()
+
 	if [ -z "$testname" ]; then
 		return
 	fi
 
-	while (( $(jobs | wc -l) == $unittest_run_queues )); do
-		# wait for any background test to finish
+	smp=$(eval echo "$3" 2>/dev/null)
+	[[ "$smp" =~ ^[0-9]+$ ]] || smp=1
+	(( smp > ${#host_cpus[@]} )) && smp=${#host_cpus[@]}
+
+	# Timings are only worth something without other tests around, but
+	# don't bother for tests that are not going to run anyway.
+	if grep -qw "perf" <<<$groups && will_run "$@"; then
+		exclusive="yes"
+	fi
+
+	# wait for enough background tests to finish
+	while reap_tasks; (( ${#task_smp[@]} )); do
+		if [ "$exclusive" = "no" ] &&
+		   (( ${#task_smp[@]} < unittest_run_queues &&
+		      cpus_used + smp <= ${#host_cpus[@]} )); then
+			break
+		fi
 		wait -n 2>/dev/null
 	done
 
+	RUNTIME_pin_cpus=
+	if [ "$pin_tasks" = "yes" ]; then
+		cpus=( "${free_cpus[@]:0:$smp}" )
+		free_cpus=( "${free_cpus[@]:$smp}" )
+		RUNTIME_pin_cpus=$(IFS=,; echo "${cpus[*]}")
+	fi
+
 	RUNTIME_log_file="${unittest_log_dir}/${testname}.log"
-	if [ $unittest_run_queues = 1 ]; then
-		run "$@"
+	if [ $unittest_run_queues = 1 ] || [ "$exclusive" = "yes" ]; then
+		run_repeated "$@"
+		free_cpus+=( "${cpus[@]}" )
 	else
-		run "$@" &
+		run_repeated "$@" &
+		task_smp[$!]=$smp
+		task_cpus[$!]="${cpus[*]}"
+		cpus_used=$((cpus_used + smp))
 	fi
 }
 
@@ -150,6 +335,9 @@ config=$TEST_DIR/unittests.cfg
 rm -rf $unittest_log_dir.old
 [ -d $unittest_log_dir ] && mv $unittest_log_dir $unittest_log_dir.old
 mkdir $unittest_log_dir || exit 2
+RUNTIME_probe_cache=$unittest_log_dir/probe-cache
+mkdir $RUNTIME_probe_cache || exit 2
+RUNTIME_duration_file=$unittest_log_dir/durations
 
 echo "BUILD_HEAD=$(cat build-head)" > $unittest_log_dir/SUMMARY
 
@@ -168,3 +356,59 @@ trap "wait; exit 130" SIGINT
 
 # wait until all tasks finish
 wait
+
+# Keep the numbers each test printed next to its durations, so that they
+# can be compared with the ones in logs.old as well.
+if (( repeat == 1 )); then
+    for log in $unittest_log_dir/*.log; do
+        [ -f "$log" ] || continue
+        testname=$(basename $log .log)
+        awk -f scripts/aggregate-metrics.awk $log > $unittest_log_dir/$testname.metrics
+        [ -s $unittest_log_dir/$testname.metrics ] || rm -f $unittest_log_dir/$testname.metrics
+    done
+else
+    [[ $tap_output == "yes" ]] && prefix="# "
+    for log in $unittest_log_dir/*.1.log; do
+        [ -f "$log" ] || continue
+        testname=$(basename $log .1.log)
+        runs=$(ls $(seq -f "$unittest_log_dir/$testname.%g.log" $repeat) 2>/dev/null)
+        awk -f scripts/aggregate-metrics.awk $runs > $unittest_log_dir/$testname.metrics
+        [ -s $unittest_log_dir/$testname.metrics ] || continue
+        echo "${prefix}$testname, median of $(wc -w <<< "$runs") runs:"
+        sed "s/^/${prefix}    /" $unittest_log_dir/$testname.metrics
+    done
+fi
+
+# Flag tests that got more than $slower_threshold percent slower than in
+# the baseline, going by the fastest run of each with -r; tests that took
+# less than a second are too noisy to tell.  Then flag the numbers the
+# tests printed that moved by more than that.
+if [ -n "$baseline" ]; then
+    [[ $tap_output == "yes" ]] && prefix="# "
+    awk -v threshold=$slower_threshold -v prefix="$prefix" '
+        FILENAME == ARGV[1] {
+            if (!($1 in base) || $2 < base[$1])
+                base[$1] = $2
+            next
+        }
+        {
+            if (!($1 in cur))
+                tests[++n] = $1
+            if (!($1 in cur) || $2 < cur[$1])
+                cur[$1] = $2
+        }
+        END {
+            for (i = 1; i <= n; i++) {
+                t = tests[i]
+                if (t in base && base[t] >= 1000 &&
+                    cur[t] > base[t] * (100 + threshold) / 100)
+                    printf "%sSLOWER %s: %d ms -> %d ms (+%d%%)\n", prefix,
+                           t, base[t], cur[t], (cur[t] - base[t]) * 100 / base[t]
+            }
+        }' <(echo "$baseline_durations") $RUNTIME_duration_file |
+        tee -a $unittest_log_dir/SUMMARY
+    awk -v threshold=$slower_threshold -v prefix="$prefix" \
+        -f scripts/compare-metrics.awk <(echo "$baseline_metrics") \
+        <(metrics_lines $unittest_log_dir/*.metrics) |
+        tee -a $unittest_log_dir/SUMMARY
+fi
@@ -19,6 +19,8 @@
 
 #include <smp.h>
 #include <alloc_page.h>
+#include <taskrun.h>
+#include <asm-generic/atomic.h>
 
 static int testflag = 0;
 
@@ -218,6 +220,30 @@ static void test_reset(void)
 	report_prefix_pop();
 }
 
+static int taskrun_hits[64];
+
+static void taskrun_func(struct task_worker *w, void *data)
+{
+	atomic_fetch_inc((int *)data);
+}
+
+/* on_cpus() skips the CPUs already set up, so run this first */
+static void test_taskrun(void)
+{
+	int i, nr_workers, bad = 0;
+
+	report_prefix_push("taskrun");
+	for (i = 0; i < 64; i++)
+		task_submit(taskrun_func, &taskrun_hits[i]);
+	nr_workers = task_run();
+	for (i = 0; i < 64; i++)
+		if (taskrun_hits[i] != 1)
+			bad++;
+	report("%d workers", nr_workers == smp_query_num_cpus(), nr_workers);
+	report("every task ran once", !bad);
+	report_prefix_pop();
+}
+
 int main(void)
 {
 	report_prefix_push("smp");
@@ -227,6 +253,7 @@ int main(void)
 		goto done;
 	}
 
+	test_taskrun();
 	test_start();
 	test_stop();
 	test_stop_store_status();
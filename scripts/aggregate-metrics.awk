@@ -0,0 +1,129 @@
+#!/usr/bin/awk -f
+#
+# Aggregate the numbers a test printed over several runs, given one log
+# per run, e.g.
+#
+#   awk -f scripts/aggregate-metrics.awk logs/vmexit.*.log
+#
+# Lines are matched up across runs by their text with the numbers taken
+# out and by how often that text showed up before in the same run, and
+# every number that differs between runs is replaced by
+# "median (min M, sd S)" over the runs.
+# Text showing up more than max_series times in a run is per-sample
+# output, like tscdeadline_latency's, and is pooled into one line instead.
+#
+# This work is licensed under the terms of the GNU LGPL, version 2.
+
+BEGIN {
+	if (!max_series)
+		max_series = 100
+	nr_tmpls = 0
+	"mktemp" | getline sort_tmp
+	close("mktemp")
+}
+
+FNR == 1 {
+	for (t in occ)
+		delete occ[t]
+}
+
+/^(PASS|FAIL|SKIP|XPASS|XFAIL|INFO|ABORT|SUMMARY|TRACE)/ { next }
+
+{
+	sub(/\r$/, "")
+	tmpl = ""
+	n = 0
+	for (i = 1; i <= NF; i++) {
+		tok = $i
+		if (match(tok, /^[[(]?[0-9]+(\.[0-9]+)?/) &&
+		    substr(tok, RLENGTH + 1, 1) !~ /[A-Za-z0-9_.]/) {
+			lead = substr(tok, 1, RLENGTH)
+			num = lead
+			sub(/^[[(]/, "", num)
+			v[++n] = num + 0
+			tok = substr(lead, 1, length(lead) - length(num)) \
+			      "\001" substr(tok, RLENGTH + 1)
+		}
+		tmpl = tmpl (i > 1 ? " " : "") tok
+	}
+	if (!n)
+		next
+
+	if (!(tmpl in max_occ)) {
+		tmpls[++nr_tmpls] = tmpl
+		max_occ[tmpl] = 0
+	}
+	o = ++occ[tmpl]
+	if (o > max_occ[tmpl])
+		max_occ[tmpl] = o
+
+	for (i = 1; i <= n; i++) {
+		k = tmpl SUBSEP o SUBSEP i
+		samples[k, ++nr_samples[k]] = v[i]
+	}
+	nr_fields[tmpl] = n
+}
+
+function fmt(x)
+{
+	return x == int(x) ? sprintf("%d", x) : sprintf("%.3f", x)
+}
+
+# Sorts s[1..n] with sort(1), pooled samples can run into the millions
+function sort_samples(s, n,    i, cmd, x)
+{
+	cmd = "sort -g > " sort_tmp
+	for (i = 1; i <= n; i++)
+		printf "%.17g\n", s[i] | cmd
+	close(cmd)
+	for (i = 1; (getline x < sort_tmp) > 0; i++)
+		s[i] = x + 0
+	close(sort_tmp)
+}
+
+# Sorts s[1..n] and returns "median (min M, sd S)", or just the number
+# if it is always the same
+function stats(s, n,    i, sum, mean, sq)
+{
+	if (n > 1)
+		sort_samples(s, n)
+	if (s[1] == s[n])
+		return fmt(s[1])
+	for (i = 1; i <= n; i++)
+		sum += s[i]
+	mean = sum / n
+	for (i = 1; i <= n; i++)
+		sq += (s[i] - mean) ^ 2
+	return sprintf("%s (min %s, sd %.1f)", fmt(s[int((n + 1) / 2)]),
+		       fmt(s[1]), n > 1 ? sqrt(sq / (n - 1)) : 0)
+}
+
+function print_line(tmpl, first, last, label,    i, o, k, n, s, line, j)
+{
+	line = tmpl
+	for (i = 1; i <= nr_fields[tmpl]; i++) {
+		n = 0
+		for (o = first; o <= last; o++) {
+			k = tmpl SUBSEP o SUBSEP i
+			for (j = 1; j <= nr_samples[k]; j++)
+				s[++n] = samples[k, j]
+		}
+		sub(/\001/, stats(s, n), line)
+		for (j in s)
+			delete s[j]
+	}
+	print line label
+}
+
+END {
+	for (t = 1; t <= nr_tmpls; t++) {
+		tmpl = tmpls[t]
+		if (max_occ[tmpl] > max_series) {
+			print_line(tmpl, 1, max_occ[tmpl], " [pooled]")
+			continue
+		}
+		for (o = 1; o <= max_occ[tmpl]; o++)
+			print_line(tmpl, o, o, "")
+	}
+	system("rm -f " sort_tmp)
+}
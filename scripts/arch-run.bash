@@ -26,7 +26,28 @@
 ##############################################################################
 run_qemu ()
 {
-	local stdout errors ret sig
+	local stdout errors ret sig pinsock pinpid perfout
+
+	if [ "$PIN_VCPUS" ] && [ "$1" != "run_migration" ]; then
+		if command -v nc >/dev/null 2>&1; then
+			pinsock=`mktemp -u -t pin-qmp.XXXXXXXXXX`
+			pin_vcpus $pinsock &
+			pinpid=$!
+			set -- "$@" -S -chardev socket,id=pinmon,path=$pinsock,server,nowait \
+				-mon chardev=pinmon,mode=control
+		else
+			echo "PIN: needs nc (netcat), not pinning"
+		fi
+	fi
+
+	if [ "$KVM_STAT" ] && [ "$1" != "run_migration" ]; then
+		if kvm_stat_usable; then
+			perfout=`mktemp -t kvm-stat.XXXXXXXXXX`
+			set -- perf stat -x, -o $perfout -e $(kvm_stat_events) -- "$@"
+		else
+			echo "KVM_STAT: perf cannot count kvm events here, not counting"
+		fi
+	fi
 
 	echo -n "$@"
 	initrd_create &&
@@ -41,6 +62,19 @@ run_qemu ()
 
 	[ $ret -eq 134 ] && echo "QEMU Aborted" >&2
 
+	# QEMU is gone, so stop waiting for its monitor if it never came up
+	if [ "$pinpid" ]; then
+		kill $pinpid 2>/dev/null
+		wait $pinpid 2>/dev/null
+		rm -f $pinsock
+	fi
+
+	if [ "$perfout" ]; then
+		awk -F, '$1 ~ /^[0-9]+$/ { sub(/^kvm:kvm_/, "", $3); print $3, $1 }' \
+			$perfout > $KVM_STAT
+		rm -f $perfout
+	fi
+
 	if [ "$errors" ]; then
 		sig=$(grep 'terminating on signal' <<<"$errors")
 		if [ "$sig" ]; then
@@ -92,6 +126,74 @@ run_qemu_status ()
 	return $ret
 }
 
+# With PIN_VCPUS=<host cpu>,<host cpu>,... run_qemu starts QEMU stopped
+# and pins vCPU n to the n-th CPU in the list, all other QEMU threads to
+# the CPUs in PIN_EMULATOR if that is set too, before the guest runs. The
+# placement is printed along with the test's output. Whatever happens the
+# guest is let go once the monitor is up; run_qemu stops this when QEMU
+# exits without bringing it up, and removes the socket.
+pin_vcpus ()
+{
+	local qmpsock=$1
+	local cpus=(${PIN_VCPUS//,/ })
+	local tids tid pid i=0
+
+	while [ ! -S $qmpsock ]; do
+		sleep 0.1
+	done
+
+	tids=$(qmp $qmpsock '"query-cpus-fast"' | grep return |
+		grep -o '"thread-id": *[0-9]*' | grep -o '[0-9]*$')
+	if [ -z "$tids" ]; then
+		echo "PIN: no vCPU threads found, not pinning"
+		qmp $qmpsock '"cont"' > /dev/null
+		return
+	fi
+	pid=$(awk '/^Tgid:/ { print $2 }' /proc/${tids%%[!0-9]*}/status 2>/dev/null)
+
+	if [ "$PIN_EMULATOR" ] && [ "$pid" ]; then
+		taskset -a -p -c $PIN_EMULATOR $pid > /dev/null &&
+			echo "PIN: QEMU threads -> CPUs $PIN_EMULATOR"
+	fi
+	for tid in $tids; do
+		if [ -z "${cpus[$i]}" ]; then
+			echo "PIN: vcpu $i (thread $tid) not pinned, PIN_VCPUS too short"
+		elif taskset -p -c ${cpus[$i]} $tid > /dev/null; then
+			echo "PIN: vcpu $i (thread $tid) -> CPU ${cpus[$i]}"
+		fi
+		((i++))
+	done
+
+	qmp $qmpsock '"cont"' > /dev/null
+}
+
+# Whether perf is there and may count the kvm tracepoints, which usually
+# takes root or a low enough kernel.perf_event_paranoid.
+kvm_stat_usable ()
+{
+	command -v perf >/dev/null 2>&1 &&
+		perf stat -e kvm:kvm_exit true >/dev/null 2>&1
+}
+
+# With KVM_STAT=<file>, run_qemu counts these KVM trace events for QEMU
+# with perf stat and leaves "<event> <count>" lines in the file, the event
+# names without the kvm_ prefix. kvm_exit counts all exits, the others
+# what some of them were for.
+kvm_stat_events ()
+{
+	local dir e events
+
+	for dir in /sys/kernel/tracing /sys/kernel/debug/tracing; do
+		[ -d $dir/events/kvm ] && break
+	done
+	for e in kvm_exit kvm_userspace_exit kvm_pio kvm_mmio kvm_msr \
+		 kvm_cpuid kvm_hypercall kvm_page_fault kvm_emulate_insn \
+		 kvm_inj_virq kvm_vcpu_wakeup; do
+		[ -d $dir/events/kvm/$e ] && events+=${events:+,}kvm:$e
+	done
+	echo ${events:-kvm:kvm_exit}
+}
+
 timeout_cmd ()
 {
 	if [ "$TIMEOUT" ] && [ "$TIMEOUT" != "0" ]; then
@@ -104,6 +206,17 @@ qmp ()
 	echo '{ "execute": "qmp_capabilities" }{ "execute":' "$2" '}' | nc -U $1
 }
 
+# Prints a number from a query-migrate reply, the first one if the name
+# shows up more than once ("ram" comes before "disk" and "xbzrle-cache").
+migration_stat ()
+{
+	grep -o "\"$1\": *[0-9]*" <<<"$2" | head -1 | grep -o '[0-9]*$'
+}
+
+# Migrates the test once it asks for it, MIGRATE_ROUNDS times (default
+# once) back and forth between a source and a freshly started destination,
+# and then lets it continue on the last destination. The numbers of each
+# round are printed from query-migrate on the source.
 run_migration ()
 {
 	if ! command -v nc >/dev/null 2>&1; then
@@ -111,6 +224,8 @@ run_migration ()
 		return 2
 	fi
 
+	local rounds=${MIGRATE_ROUNDS:-1} round src dst tries
+
 	migsock=`mktemp -u -t mig-helper-socket.XXXXXXXXXX`
 	migout1=`mktemp -t mig-helper-stdout1.XXXXXXXXXX`
 	qmp1=`mktemp -u -t mig-helper-qmp1.XXXXXXXXXX`
@@ -129,31 +244,69 @@ run_migration ()
 	# pipes, will block on open() until the other end is also opened, and that
 	# totally breaks QEMU...
 	mkfifo ${fifo}
-	eval "$@" -chardev socket,id=mon2,path=${qmp2},server,nowait \
-		-mon chardev=mon2,mode=control -incoming unix:${migsock} < <(cat ${fifo}) &
-	incoming_pid=`jobs -l %+ | awk '{print$2}'`
 
 	# The test must prompt the user to migrate, so wait for the "migrate" keyword
 	while ! grep -q -i "migrate" < ${migout1} ; do
 		sleep 1
 	done
 
-	qmp ${qmp1} '"migrate", "arguments": { "uri": "unix:'${migsock}'" }' > ${qmpout1}
+	src=${qmp1}
+	dst=${qmp2}
+	for ((round = 1; round <= rounds; round++)); do
+		rm -f ${migsock} ${dst}
+		# Only the last destination gets to see the key press
+		if [ $round -eq $rounds ]; then
+			eval "$@" -chardev socket,id=mon2,path=${dst},server,nowait \
+				-mon chardev=mon2,mode=control \
+				-incoming unix:${migsock} < <(cat ${fifo}) &
+		else
+			eval "$@" -chardev socket,id=mon2,path=${dst},server,nowait \
+				-mon chardev=mon2,mode=control \
+				-incoming unix:${migsock} < /dev/null &
+		fi
+		incoming_pid=`jobs -l %+ | awk '{print$2}'`
+
+		tries=0
+		while [ ! -S ${migsock} ] || [ ! -S ${dst} ]; do
+			if (( ++tries > 100 )); then
+				echo "ERROR: Migration destination did not start." >&2
+				qmp ${src} '"quit"'> ${qmpout1} 2>/dev/null
+				kill ${incoming_pid} 2>/dev/null
+				return 2
+			fi
+			sleep 0.1
+		done
 
-	# Wait for the migration to complete
-	migstatus=`qmp ${qmp1} '"query-migrate"' | grep return`
-	while ! grep -q '"completed"' <<<"$migstatus" ; do
-		sleep 1
-		migstatus=`qmp ${qmp1} '"query-migrate"' | grep return`
-		if grep -q '"failed"' <<<"$migstatus" ; then
-			echo "ERROR: Migration failed." >&2
-			qmp ${qmp1} '"quit"'> ${qmpout1} 2>/dev/null
-			qmp ${qmp2} '"quit"'> ${qmpout2} 2>/dev/null
-			return 2
+		qmp ${src} '"migrate", "arguments": { "uri": "unix:'${migsock}'" }' > ${qmpout1}
+
+		# Wait for the migration to complete
+		migstatus=`qmp ${src} '"query-migrate"' | grep return`
+		while ! grep -q '"completed"' <<<"$migstatus" ; do
+			sleep 0.1
+			migstatus=`qmp ${src} '"query-migrate"' | grep return`
+			if grep -q '"failed"' <<<"$migstatus" ; then
+				echo "ERROR: Migration failed." >&2
+				qmp ${src} '"quit"'> ${qmpout1} 2>/dev/null
+				qmp ${dst} '"quit"'> ${qmpout2} 2>/dev/null
+				return 2
+			fi
+		done
+		# Let the test know right away, it may be timing the migration
+		if [ $round -eq $rounds ]; then
+			echo > ${fifo}
 		fi
+		echo "MIGRATION: round $round/$rounds:" \
+		     "total-time $(migration_stat total-time "$migstatus") ms," \
+		     "downtime $(migration_stat downtime "$migstatus") ms," \
+		     "setup-time $(migration_stat setup-time "$migstatus") ms," \
+		     "transferred $(migration_stat transferred "$migstatus") bytes," \
+		     "dirty-sync-count $(migration_stat dirty-sync-count "$migstatus")"
+
+		qmp ${src} '"quit"'> ${qmpout1} 2>/dev/null
+		src=${dst}
+		[ ${dst} = ${qmp1} ] && dst=${qmp2} || dst=${qmp1}
 	done
-	qmp ${qmp1} '"quit"'> ${qmpout1} 2>/dev/null
-	echo > ${fifo}
+
 	wait $incoming_pid
 	ret=$?
 	wait
@@ -0,0 +1,87 @@
+#!/usr/bin/awk -f
+#
+# Compare the numbers tests printed with those of a baseline run, given
+# the .metrics files of both (see aggregate-metrics.awk) as lines of
+# "<test>\t<line>", the baseline first, e.g.
+#
+#   awk -v threshold=20 -f scripts/compare-metrics.awk old new
+#
+# Lines are matched up by test, by their text with the numbers taken out
+# and by how often that text showed up before.  Lines with a number that
+# moved by more than threshold percent are printed as
+# "CHANGED <test>: <line>", each such number shown as "<old> -> <new>".
+# Whether more is better depends on the number, so both ways count.
+# Aggregated numbers are compared by their median.
+#
+# This work is licensed under the terms of the GNU LGPL, version 2.
+
+BEGIN {
+	FS = "\t"
+	if (threshold == "")
+		threshold = 20
+}
+
+function fmt(x)
+{
+	return x == int(x) ? sprintf("%d", x) : sprintf("%.3f", x)
+}
+
+# Sets tmpl to the line with its numbers replaced by \001, and v[1..nv]
+# to the numbers
+function parse(line,    i, nf, f, tok, lead, num)
+{
+	gsub(/ \(min [^)]*\)/, "", line)
+	sub(/ \[pooled\]$/, "", line)
+	tmpl = ""
+	nv = 0
+	nf = split(line, f, " ")
+	for (i = 1; i <= nf; i++) {
+		tok = f[i]
+		if (match(tok, /^[[(]?[0-9]+(\.[0-9]+)?/) &&
+		    substr(tok, RLENGTH + 1, 1) !~ /[A-Za-z0-9_.]/) {
+			lead = substr(tok, 1, RLENGTH)
+			num = lead
+			sub(/^[[(]/, "", num)
+			v[++nv] = num + 0
+			tok = substr(lead, 1, length(lead) - length(num)) \
+			      "\001" substr(tok, RLENGTH + 1)
+		}
+		tmpl = tmpl (i > 1 ? " " : "") tok
+	}
+}
+
+FILENAME == ARGV[1] {
+	parse($2)
+	o = ++base_occ[$1, tmpl]
+	k = $1 SUBSEP tmpl SUBSEP o
+	base_nv[k] = nv
+	for (i = 1; i <= nv; i++)
+		base[k, i] = v[i]
+	next
+}
+
+{
+	parse($2)
+	o = ++occ[$1, tmpl]
+	k = $1 SUBSEP tmpl SUBSEP o
+	if (!(k in base_nv) || base_nv[k] != nv)
+		next
+
+	line = tmpl
+	changed = 0
+	for (i = 1; i <= nv; i++) {
+		old = base[k, i]
+		s = fmt(v[i])
+		if (old) {
+			pct = (v[i] - old) * 100 / (old < 0 ? -old : old)
+			if (pct > threshold || pct < -threshold) {
+				s = sprintf("%s -> %s (%s%d%%)", fmt(old), s,
+					    pct > 0 ? "+" : "", pct)
+				changed = 1
+			}
+		}
+		sub(/\001/, s, line)
+	}
+	if (changed)
+		printf "%sCHANGED %s: %s\n", prefix, $1, line
+}
@@ -12,10 +12,29 @@ extract_summary()
     tail -3 | grep '^SUMMARY: ' | sed 's/^SUMMARY: /(/;s/'"$cr"'\{0,1\}$/)/'
 }
 
-# We assume that QEMU is going to work if it tried to load the kernel
+# We assume that QEMU is going to work if it tried to load the kernel.
+# That only depends on how QEMU is started, so if RUNTIME_probe_cache
+# names a directory, the probe's output is kept there for all tests that
+# start QEMU the same way.
 premature_failure()
 {
-    local log="$(eval $(get_cmdline _NO_FILE_4Uhere_) 2>&1)"
+    local log key cache
+
+    if [ -n "$RUNTIME_probe_cache" ]; then
+        key=$(md5sum <<< "$QEMU|$accel|$smp|$opts" | cut -d' ' -f1)
+        cache="$RUNTIME_probe_cache/$key"
+    fi
+
+    if [ -n "$cache" ] && [ -f "$cache" ]; then
+        log="$(<"$cache")"
+    else
+        # no kernel to pin vCPUs for, and nothing to count
+        log="$(eval PIN_VCPUS= KVM_STAT= $(get_cmdline _NO_FILE_4Uhere_) 2>&1)"
+        if [ -n "$cache" ]; then
+            echo "$log" > "$cache.$BASHPID"
+            mv "$cache.$BASHPID" "$cache"
+        fi
+    fi
 
     echo "$log" | grep "_NO_FILE_4Uhere_" |
         grep -q -e "could not load kernel" -e "error loading" &&
@@ -30,7 +49,8 @@ premature_failure()
 get_cmdline()
 {
     local kernel=$1
-    echo "TESTNAME=$testname TIMEOUT=$timeout ACCEL=$accel $RUNTIME_arch_run $kernel -smp $smp $opts"
+    local pin=${RUNTIME_pin_cpus:+taskset -c $RUNTIME_pin_cpus }
+    echo "TESTNAME=$testname TIMEOUT=$timeout ACCEL=$accel $pin$RUNTIME_arch_run $kernel -smp $smp $opts"
 }
 
 skip_nodefault()
@@ -79,6 +99,7 @@ function run()
     local check="${CHECK:-$7}"
     local accel="${ACCEL:-$8}"
     local timeout="${9:-$TIMEOUT}" # unittests.cfg overrides the default
+    local kvm_stat start duration
 
     if [ -z "$testname" ]; then
         return
@@ -124,6 +145,10 @@ function run()
     if grep -qw "migration" <<<$groups ; then
         cmdline="MIGRATION=yes $cmdline"
     fi
+    if [ "$RUNTIME_kvm_stat" = "yes" ]; then
+        kvm_stat=$(mktemp -t kvm-stat.XXXXXXXXXX)
+        cmdline="KVM_STAT=$kvm_stat $cmdline"
+    fi
     if [ "$verbose" = "yes" ]; then
         echo $cmdline
     fi
@@ -131,11 +156,29 @@ function run()
     # extra_params in the config file may contain backticks that need to be
     # expanded, so use eval to start qemu.  Use "> >(foo)" instead of a pipe to
     # preserve the exit status.
+    start=$(date +%s%N)
     summary=$(eval $cmdline 2> >(RUNTIME_log_stderr) \
                              > >(tee >(RUNTIME_log_stdout $kernel) | extract_summary))
     ret=$?
+    duration=$((($(date +%s%N) - start) / 1000000))
+    if [ -n "$RUNTIME_duration_file" ]; then
+        echo "$testname $duration $ret" >> $RUNTIME_duration_file
+    fi
     [ "$STANDALONE" != "yes" ] && echo > >(RUNTIME_log_stdout $kernel)
 
+    # "<event> <count>" lines from run_qemu, see scripts/arch-run.bash
+    if [ "$kvm_stat" ]; then
+        if [ -s $kvm_stat ]; then
+            awk -v ms=$duration '{
+                printf "KVM_STAT: %s %d (%d/s)\n", $1, $2, ms ? $2 * 1000 / ms : 0
+            }' $kvm_stat | RUNTIME_log_stderr
+            summary+=$(awk -v ms=$duration '$1 == "exit" {
+                printf " [%d exits, %d/s]", $2, ms ? $2 * 1000 / ms : 0
+            }' $kvm_stat)
+        fi
+        rm -f $kvm_stat
+    fi
+
     if [ $ret -eq 0 ]; then
         print_result "PASS" $testname "$summary"
     elif [ $ret -eq 77 ]; then
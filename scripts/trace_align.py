@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+#
+# Line up guest trace markers (trace_mark() in lib/x86/trace.h) with a host
+# ftrace, e.g.
+#
+#   # cd /sys/kernel/debug/tracing
+#   # echo x86-tsc > trace_clock
+#   # echo "kvm_exit kvm_entry kvm_hypercall sched_switch" > set_event
+#   ... run the test ...
+#   # scripts/trace_align.py --khz 2100000 < trace
+#
+# Every marker shows up as a kvm_hypercall event carrying the guest TSC
+# from right before the exit. Guest and host TSC differ by the vCPU's TSC
+# offset, which is estimated per vCPU thread as the smallest difference
+# between the host timestamp and the guest TSC of its markers. For each
+# marker the script then prints the host events of the vCPU thread and of
+# the host CPU it ran on that precede it, with times relative to the point
+# the guest placed the marker.
+#
+# This work is licensed under the terms of the GNU LGPL, version 2.
+
+import argparse
+import re
+import sys
+
+TRACE_MARK_HC = 0x6b7574
+
+line_re = re.compile(r'^\s*(?P<task>.+?)-(?P<pid>\d+)\s+(?:\(.*?\)\s+)?'
+                     r'\[(?P<cpu>\d+)\]\s+(?:\S+\s+)?(?P<ts>\d+):\s+'
+                     r'(?P<event>\w+):\s*(?P<rest>.*)$')
+hypercall_re = re.compile(r'nr (?P<nr>0x[0-9a-f]+) a0 (?P<a0>0x[0-9a-f]+) '
+                          r'a1 (?P<a1>0x[0-9a-f]+) a2 (?P<a2>0x[0-9a-f]+)')
+
+def signed64(x):
+    x &= (1 << 64) - 1
+    return x - (1 << 64) if x >> 63 else x
+
+def parse(f):
+    events = []
+    for line in f:
+        m = line_re.match(line)
+        if not m:
+            continue
+        ev = {
+            'task': m.group('task'),
+            'pid': int(m.group('pid')),
+            'cpu': int(m.group('cpu')),
+            'ts': int(m.group('ts')),
+            'event': m.group('event'),
+            'rest': m.group('rest'),
+        }
+        if ev['event'] == 'kvm_hypercall':
+            h = hypercall_re.match(ev['rest'])
+            if h and int(h.group('nr'), 16) == TRACE_MARK_HC:
+                ev['mark'] = int(h.group('a0'), 16)
+                ev['guest_tsc'] = int(h.group('a1'), 16)
+                ev['arg'] = int(h.group('a2'), 16)
+        events.append(ev)
+    return events
+
+def fmt_time(cycles, khz):
+    if khz:
+        return '%+12.3f us' % (cycles * 1000.0 / khz)
+    return '%+12d cyc' % cycles
+
+def main():
+    ap = argparse.ArgumentParser(description='Align guest trace markers '
+                                 'with a host ftrace taken with the x86-tsc '
+                                 'trace clock.')
+    ap.add_argument('trace', nargs='?', type=argparse.FileType('r'),
+                    default=sys.stdin)
+    ap.add_argument('--khz', type=int, default=0,
+                    help='TSC frequency, to print microseconds')
+    ap.add_argument('--window', type=int, default=1000000,
+                    help='cycles of host events to show before each marker')
+    args = ap.parse_args()
+
+    events = parse(args.trace)
+    marks = [ev for ev in events if 'mark' in ev]
+    if not marks:
+        sys.exit('no guest markers found, was kvm_hypercall traced?')
+
+    offset = {}
+    for ev in marks:
+        d = signed64(ev['ts'] - ev['guest_tsc'])
+        offset[ev['pid']] = min(offset.get(ev['pid'], d), d)
+
+    for pid in sorted(offset):
+        print('vCPU thread %d: guest TSC + %d = host TSC' % (pid, offset[pid]))
+
+    for ev in marks:
+        at = ev['guest_tsc'] + offset[ev['pid']]
+        print('')
+        print('marker %d arg %#x, %s-%d on CPU %d, exit seen %d cycles later'
+              % (ev['mark'], ev['arg'], ev['task'], ev['pid'], ev['cpu'],
+                 ev['ts'] - at))
+        for e in events:
+            if e['ts'] < at - args.window or e['ts'] > ev['ts']:
+                continue
+            if e['pid'] != ev['pid'] and e['cpu'] != ev['cpu']:
+                continue
+            print('  %s  %s-%d [%03d] %s: %s'
+                  % (fmt_time(e['ts'] - at, args.khz), e['task'], e['pid'],
+                     e['cpu'], e['event'], e['rest']))
+
+if __name__ == '__main__':
+    main()
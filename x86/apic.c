@@ -7,6 +7,7 @@
 #include "msr.h"
 #include "atomic.h"
 #include "fwcfg.h"
+#include "kvm_para.h"
 
 #define MAX_TPR			0xf
 
@@ -630,8 +631,6 @@ static void test_apic_change_mode(void)
 	report("TMCCT should stay at zero", !apic_read(APIC_TMCCT));
 }
 
-#define KVM_HC_SEND_IPI 10
-
 static void test_pv_ipi(void)
 {
     int ret;
@@ -0,0 +1,323 @@
+/*
+ * Dirty memory at a controlled rate while being migrated
+ *
+ * All vCPUs but the first write to a working set of wss= MB, each to its
+ * own slice of it, at rate= MB/s in total (0: as fast as they can), one
+ * write per page in one of these patterns:
+ *
+ * - seq: every page in turn;
+ * - random: pages picked at random;
+ * - hotcold: 90% of the writes go to the first hot= percent of the slice.
+ *
+ * After base= ms of dirtying without migration the test asks to be
+ * migrated (see run_migration; MIGRATE_ROUNDS works too) and goes on
+ * dirtying until the migration completes, or stops after timeout=
+ * seconds to let it converge.  It then reports whether the migration
+ * converged with the workload running, the rate actually reached and the
+ * cost of a write compared with before the migration, and the worst 100 ms
+ * any vCPU had.  Dirty logging shows up as more expensive writes,
+ * throttling (auto-converge) as a lower rate.  For the pause itself see
+ * migration_downtime and the numbers run_migration prints.
+ *
+ * The guest only learns that the migration is over from the key
+ * run_migration sends, as soon as it sees the last round complete, so
+ * "while migrating" also covers up to one of its 100 ms polls on the
+ * destination.  With MIGRATE_ROUNDS it also covers starting each next
+ * destination, during which the guest runs undisturbed.
+ *
+ * Like tdp_fault_bench, the test runs on the boot page tables and dirties
+ * the memory above its image directly, so give the guest enough with -m.
+ *
+ * Usage: -append "[rate=<MB/s>] [wss=<MB>] [hot=<percent>] [base=<ms>] [timeout=<s>] [seq|random|hotcold]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "atomic.h"
+#include "smp.h"
+#include "apic.h"
+#include "delay.h"
+#include "alloc_phys.h"
+#include "asm/page.h"
+#include "migrate.h"
+#include "util.h"
+
+enum {
+	SEQ,
+	RANDOM,
+	HOTCOLD,
+	NR_PATTERNS
+};
+
+static const char *pattern_names[NR_PATTERNS] = { "seq", "random", "hotcold" };
+
+enum {
+	WARMUP,
+	BASELINE,
+	MIGRATING,
+	STOPPED,	/* timed out, waiting for the migration to converge */
+	DONE,
+	NR_PHASES
+};
+
+#define HOT_WRITES	90	/* percent of the writes going to the hot set */
+
+struct dirtier {
+	u8 *base;
+	ulong nr_pages;
+	ulong hot_pages;
+	ulong idx;
+	u64 rng;
+	u64 next;		/* TSC of the next write when rate limited */
+	u64 pages[NR_PHASES];
+	u64 write_cycles[NR_PHASES];
+	u64 win_start;
+	u64 win_pages;
+	u64 worst_win;		/* fewest pages in a window while migrating */
+} __attribute__((aligned(64)));
+
+static struct dirtier dirtiers[MAX_TEST_CPUS];
+static volatile int phase = WARMUP;
+static atomic_t nr_ready, nr_exited;
+static int pattern = RANDOM;
+static u64 cycles_per_page, win_cycles, timeout_cycles;
+static u64 t_migrate, t_stop;
+
+static u64 xorshift(u64 *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static ulong next_page(struct dirtier *d)
+{
+	u64 r;
+
+	switch (pattern) {
+	case SEQ:
+		if (++d->idx == d->nr_pages)
+			d->idx = 0;
+		return d->idx;
+	case RANDOM:
+		return xorshift(&d->rng) % d->nr_pages;
+	default:
+		r = xorshift(&d->rng);
+		if (r % 100 < HOT_WRITES || d->hot_pages == d->nr_pages)
+			return (r >> 8) % d->hot_pages;
+		return d->hot_pages + (r >> 8) % (d->nr_pages - d->hot_pages);
+	}
+}
+
+static void end_window(struct dirtier *d, int ph, u64 now)
+{
+	if (ph == MIGRATING && d->win_pages < d->worst_win)
+		d->worst_win = d->win_pages;
+	d->win_start = now;
+	d->win_pages = 0;
+}
+
+static void dirty(void *data)
+{
+	struct dirtier *d = data;
+	u64 now, t, slack = win_cycles / 10;
+	ulong i;
+	int ph;
+
+	/* Fault the working set in first, outside of the measurement. */
+	for (i = 0; i < d->nr_pages; i++)
+		*(volatile u64 *)(d->base + i * PAGE_SIZE) = 0;
+	atomic_inc(&nr_ready);
+	while (phase == WARMUP)
+		pause();
+
+	d->next = d->win_start = rdtsc();
+	while ((ph = phase) != DONE) {
+		now = rdtsc();
+		if (now - d->win_start >= win_cycles)
+			end_window(d, ph, now);
+
+		if (ph == STOPPED || (cycles_per_page && now < d->next)) {
+			pause();
+			continue;
+		}
+		if (cycles_per_page) {
+			/* Don't make up for lost time in one burst. */
+			if (d->next + slack < now)
+				d->next = now - slack;
+			d->next += cycles_per_page;
+		}
+
+		i = next_page(d);
+		t = rdtsc();
+		*(volatile u64 *)(d->base + i * PAGE_SIZE + (t & 0xff8)) = t;
+		d->write_cycles[ph] += rdtsc() - t;
+		d->pages[ph]++;
+		d->win_pages++;
+	}
+	atomic_inc(&nr_exited);
+}
+
+/* Called while waiting for the migration, which is asked for by now. */
+static void check_timeout(void *data)
+{
+	if (phase == BASELINE) {
+		t_migrate = rdtsc();
+		phase = MIGRATING;
+	}
+	if (phase == MIGRATING && timeout_cycles &&
+	    rdtsc() - t_migrate > timeout_cycles) {
+		t_stop = rdtsc();
+		phase = STOPPED;
+	}
+}
+
+/* MB/s from a number of 4K pages written over that many cycles */
+static u64 mb_per_s(u64 pages, u64 cycles, u64 khz)
+{
+	return cycles ? pages * (khz * 1000 / 256) / cycles : 0;
+}
+
+static u64 per_write(int ph, int nr)
+{
+	u64 pages = 0, cycles = 0;
+	int i;
+
+	for (i = 1; i <= nr; i++) {
+		pages += dirtiers[i].pages[ph];
+		cycles += dirtiers[i].write_cycles[ph];
+	}
+	return pages ? cycles / pages : 0;
+}
+
+static u64 total_pages(int ph, int nr)
+{
+	u64 pages = 0;
+	int i;
+
+	for (i = 1; i <= nr; i++)
+		pages += dirtiers[i].pages[ph];
+	return pages;
+}
+
+int main(int ac, char **av)
+{
+	long rate = 0, wss = 256, hot = 10, base_ms = 2000, timeout = 0, val;
+	u64 khz, t_base, t_done, base_cycles, mig_cycles, worst = -1ull;
+	u64 base_write, mig_write, base_rate, mig_rate, base_win;
+	phys_addr_t start, top;
+	ulong slice;
+	int i, m, nr;
+
+	smp_init();
+
+	for (i = 1; i < ac; i++) {
+		if (parse_keyval(av[i], &val) > 0) {
+			if (!strncmp(av[i], "rate=", 5))
+				rate = val;
+			else if (!strncmp(av[i], "wss=", 4))
+				wss = val;
+			else if (!strncmp(av[i], "hot=", 4))
+				hot = val;
+			else if (!strncmp(av[i], "base=", 5))
+				base_ms = val;
+			else if (!strncmp(av[i], "timeout=", 8))
+				timeout = val;
+			else
+				report_abort("unknown argument: %s", av[i]);
+			continue;
+		}
+		for (m = 0; m < NR_PATTERNS; m++)
+			if (!strcmp(av[i], pattern_names[m]))
+				break;
+		if (m == NR_PATTERNS)
+			report_abort("unknown argument: %s", av[i]);
+		pattern = m;
+	}
+
+	nr = cpu_count() - 1;
+	if (nr < 1)
+		report_abort("needs 2 vcpus");
+	if (rate < 0 || wss < 1 || hot < 1 || hot > 100 || base_ms < 100 ||
+	    timeout < 0)
+		report_abort("invalid rate=%ld wss=%ld hot=%ld base=%ld timeout=%ld",
+			     rate, wss, hot, base_ms, timeout);
+
+	khz = tsc_khz();
+	if (!khz)
+		report_abort("cannot determine the TSC frequency");
+	win_cycles = khz * 100;
+	timeout_cycles = timeout * khz * 1000;
+	if (rate)
+		cycles_per_page = khz * 1000 * nr / ((u64)rate * 256);
+
+	/* Everything above the test image is free, see tdp_fault_bench. */
+	phys_alloc_get_unused(&start, &top);
+	start = ALIGN(start, LARGE_PAGE_SIZE);
+	top = MIN(top, 1ull << 32);
+	slice = ((u64)wss << 20) / nr & PAGE_MASK;
+	if (!slice || start + slice * nr > top)
+		report_abort("not enough memory for wss=%ld MB", wss);
+
+	for (i = 1; i <= nr; i++) {
+		struct dirtier *d = &dirtiers[i];
+
+		d->base = (u8 *)(ulong)(start + (i - 1) * slice);
+		d->nr_pages = slice / PAGE_SIZE;
+		d->hot_pages = MAX(d->nr_pages * hot / 100, 1ul);
+		d->rng = 0x9e3779b97f4a7c15ull * i;
+		d->worst_win = -1ull;
+		on_cpu_async(i, dirty, d);
+	}
+
+	printf("%s, wss %ld MB over %d vcpus, ", pattern_names[pattern], wss, nr);
+	if (rate)
+		printf("%ld MB/s", rate);
+	else
+		printf("unlimited rate");
+	printf(", TSC %ld kHz\n", khz);
+
+	while (atomic_read(&nr_ready) < nr)
+		pause();
+	t_base = rdtsc();
+	phase = BASELINE;
+	while (rdtsc() - t_base < base_ms * khz)
+		pause();
+
+	migrate_poll(check_timeout, NULL);
+	t_done = rdtsc();
+	phase = DONE;
+	while (atomic_read(&nr_exited) < nr)
+		pause();
+
+	base_cycles = t_migrate - t_base;
+	mig_cycles = (t_stop ? t_stop : t_done) - t_migrate;
+	base_write = per_write(BASELINE, nr);
+	mig_write = per_write(MIGRATING, nr);
+	base_rate = mb_per_s(total_pages(BASELINE, nr), base_cycles, khz);
+	mig_rate = mb_per_s(total_pages(MIGRATING, nr), mig_cycles, khz);
+	for (i = 1; i <= nr; i++)
+		worst = MIN(worst, dirtiers[i].worst_win);
+	base_win = total_pages(BASELINE, nr) * win_cycles / base_cycles / nr;
+
+	printf("before migration: %ld MB/s, %ld cycles/write\n",
+	       base_rate, base_write);
+	printf("while migrating:  %ld MB/s (%ld%%), %ld cycles/write (%ld.%02ldx)\n",
+	       mig_rate, base_rate ? mig_rate * 100 / base_rate : 0, mig_write,
+	       base_write ? mig_write / base_write : 0,
+	       base_write ? mig_write * 100 / base_write % 100 : 0);
+	if (worst != -1ull)
+		printf("worst 100 ms on a vcpu: %ld%% of the writes before migration\n",
+		       base_win ? worst * 100 / base_win : 0);
+	if (t_stop)
+		report_info("not converged after %ld ms of dirtying, completed %ld ms after stopping",
+			    (t_stop - t_migrate) / khz, (t_done - t_stop) / khz);
+	else
+		report_info("converged after %ld ms of dirtying",
+			    (t_done - t_migrate) / khz);
+	report("migration converged while dirtying", !t_stop);
+
+	return report_summary();
+}
@@ -0,0 +1,253 @@
+/*
+ * HLT wakeup latency benchmark
+ *
+ * Puts a vCPU into HLT for a given time and measures how long it takes to
+ * get to the interrupt handler once the wakeup event fires, for idle times
+ * doubling from min= up to max= microseconds.  The wakeup is either an IPI
+ * from another vCPU ("ipi", the handler time minus the time the ICR was
+ * written) or the vCPU's own TSC deadline timer ("timer", the handler time
+ * minus the deadline).  Latencies are reported as percentiles over
+ * samples= wakeups per idle time.
+ *
+ * Idle times below the host's halt_poll_ns should show a much lower
+ * latency than longer ones, which the host spent descheduled; compare with
+ * the host CPU time burnt by polling.  gpoll= emulates guest-side halt
+ * polling (cpuidle-haltpoll): the vCPU first spins with interrupts enabled
+ * for that many microseconds and only then executes HLT.  With trace=<n>
+ * the last n idle/wakeup events of each vCPU are dumped at the end, see
+ * lib/x86/trace.h.
+ *
+ * Usage: -append "[min=<us>] [max=<us>] [samples=<n>] [gpoll=<us>] [trace=<n>] [ipi] [timer]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "smp.h"
+#include "apic.h"
+#include "isr.h"
+#include "msr.h"
+#include "vm.h"
+#include "delay.h"
+#include "trace.h"
+#include "util.h"
+
+#define WAKEUP_VECTOR	0xb2
+#define MAX_SAMPLES	10000
+
+enum {
+	WAKE_IPI,
+	WAKE_TIMER,
+	NR_WAKEUPS
+};
+
+static const char *wakeup_names[NR_WAKEUPS] = { "ipi", "timer" };
+
+enum {
+	TR_IDLE,
+	TR_WAKE,
+	TR_IRQ,
+	TR_RESUME,
+};
+
+static const char *const trace_names[] = { "idle", "wake", "irq", "resume" };
+
+static volatile bool woken;
+static volatile u64 arrival;
+static volatile int sample, armed;
+static volatile bool stop;
+static u64 poll_cycles;
+static ulong polled;
+static u64 latency[MAX_SAMPLES];
+
+static void wakeup_isr(isr_regs_t *regs)
+{
+	arrival = rdtsc();
+	woken = true;
+	trace(TR_IRQ, 0, 0);
+	eoi();
+}
+
+/* Called with interrupts disabled, returns the same way once woken. */
+static void idle(void)
+{
+	u64 end;
+
+	trace(TR_IDLE, 0, 0);
+	if (poll_cycles) {
+		end = rdtsc() + poll_cycles;
+		irq_enable();
+		while (!woken && rdtsc() < end)
+			pause();
+		irq_disable();
+		if (woken) {
+			polled++;
+			trace(TR_RESUME, 1, 0);
+			return;
+		}
+	}
+	safe_halt();
+	irq_disable();
+	trace(TR_RESUME, 0, 0);
+}
+
+static void ipi_receiver(void *data)
+{
+	int n = 0;
+
+	irq_disable();
+	for (;;) {
+		while (sample == n)
+			pause();
+		if (stop)
+			break;
+		n = sample;
+		woken = false;
+		armed = n;
+		idle();
+	}
+}
+
+static u64 wake_by_ipi(u64 sleep)
+{
+	u64 t;
+
+	sample++;
+	while (armed != sample)
+		pause();
+
+	for (t = rdtsc(); rdtsc() - t < sleep;)
+		pause();
+
+	trace(TR_WAKE, sample, 0);
+	t = rdtsc();
+	apic_icr_write(APIC_DEST_PHYSICAL | APIC_DM_FIXED | WAKEUP_VECTOR,
+		       id_map[1]);
+	while (!woken)
+		pause();
+	return arrival - t;
+}
+
+static u64 wake_by_timer(u64 sleep)
+{
+	u64 deadline;
+
+	irq_disable();
+	woken = false;
+	deadline = rdtsc() + sleep;
+	trace(TR_WAKE, deadline, 0);
+	wrmsr(MSR_IA32_TSCDEADLINE, deadline);
+	idle();
+	irq_enable();
+	return arrival - deadline;
+}
+
+static u64 to_ns(u64 cycles, u64 khz)
+{
+	return cycles * 1000000 / khz;
+}
+
+static void run(int wakeup, long us, int samples, u64 khz)
+{
+	u64 sleep = us * khz / 1000;
+	int i;
+
+	polled = 0;
+	for (i = 0; i < samples; i++)
+		latency[i] = wakeup == WAKE_IPI ? wake_by_ipi(sleep)
+						: wake_by_timer(sleep);
+	sort_u64(latency, samples);
+
+	printf("%-5s idle %6ld us: p50 %6ld p90 %6ld p99 %6ld max %6ld ns",
+	       wakeup_names[wakeup], us,
+	       to_ns(latency[samples / 2], khz),
+	       to_ns(latency[samples * 90 / 100], khz),
+	       to_ns(latency[samples * 99 / 100], khz),
+	       to_ns(latency[samples - 1], khz));
+	if (poll_cycles)
+		printf(", %ld%% polled", polled * 100 / samples);
+	printf("\n");
+}
+
+int main(int ac, char **av)
+{
+	bool wanted[NR_WAKEUPS] = { false }, any = false;
+	long min = 1, max = 2048, samples = 200, gpoll = 0, nr_trace = 0;
+	long val, us;
+	u64 khz;
+	int i, w;
+
+	setup_vm();
+	smp_init();
+
+	for (i = 1; i < ac; i++) {
+		if (parse_keyval(av[i], &val) > 0) {
+			if (!strncmp(av[i], "min=", 4))
+				min = val;
+			else if (!strncmp(av[i], "max=", 4))
+				max = val;
+			else if (!strncmp(av[i], "samples=", 8))
+				samples = val;
+			else if (!strncmp(av[i], "gpoll=", 6))
+				gpoll = val;
+			else if (!strncmp(av[i], "trace=", 6))
+				nr_trace = val;
+			else
+				report_abort("unknown argument: %s", av[i]);
+			continue;
+		}
+		for (w = 0; w < NR_WAKEUPS; w++)
+			if (!strcmp(av[i], wakeup_names[w]))
+				break;
+		if (w == NR_WAKEUPS)
+			report_abort("unknown argument: %s", av[i]);
+		wanted[w] = any = true;
+	}
+	if (!any)
+		for (w = 0; w < NR_WAKEUPS; w++)
+			wanted[w] = true;
+
+	if (min < 1 || max < min || samples < 1 || samples > MAX_SAMPLES)
+		report_abort("invalid min=%ld max=%ld samples=%ld",
+			     min, max, samples);
+
+	khz = tsc_khz();
+	if (!khz)
+		report_abort("cannot determine the TSC frequency");
+	poll_cycles = gpoll * khz / 1000;
+
+	if (wanted[WAKE_IPI] && cpu_count() < 2) {
+		report_skip("ipi: needs 2 vcpus");
+		wanted[WAKE_IPI] = false;
+	}
+	if (wanted[WAKE_TIMER] && !this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER)) {
+		report_skip("timer: no TSC deadline timer");
+		wanted[WAKE_TIMER] = false;
+	}
+
+	if (nr_trace > 0)
+		trace_init(nr_trace);
+
+	handle_irq(WAKEUP_VECTOR, wakeup_isr);
+	printf("TSC %ld kHz, %ld samples, guest halt polling %ld us\n",
+	       khz, samples, gpoll);
+
+	if (wanted[WAKE_IPI]) {
+		on_cpu_async(1, ipi_receiver, NULL);
+		for (us = min; us <= max; us *= 2)
+			run(WAKE_IPI, us, samples, khz);
+		stop = true;
+		sample++;
+	}
+
+	if (wanted[WAKE_TIMER]) {
+		apic_write(APIC_LVTT, APIC_LVT_TIMER_TSCDEADLINE | WAKEUP_VECTOR);
+		for (us = min; us <= max; us *= 2)
+			run(WAKE_TIMER, us, samples, khz);
+	}
+
+	if (nr_trace > 0)
+		trace_dump(trace_names, ARRAY_SIZE(trace_names));
+
+	return report_summary();
+}
@@ -0,0 +1,31 @@
+/*
+ * Migration downtime as seen by the guest
+ *
+ * Asks to be migrated (MIGRATE_ROUNDS=<n> in the environment of
+ * run_tests.sh or x86/run makes that n migrations back and forth) and
+ * prints how much wall clock time the guest's TSC missed in the
+ * meantime, i.e. how long it was paused in total, and the longest stall
+ * it did notice, see lib/x86/migrate_pause.h.  Compare with the
+ * downtime per round that run_migration prints from query-migrate.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "migrate_pause.h"
+
+int main(int ac, char **av)
+{
+	struct migrate_pause p;
+
+	if (!migrate_measure_pause(&p)) {
+		report_skip("cannot determine the TSC frequency");
+		return report_summary();
+	}
+
+	printf("wall %ld ms, guest %ld ms: paused %ld.%03ld ms, longest stall seen %ld us\n",
+	       p.wall_us / 1000, p.guest_us / 1000, p.hidden_us / 1000,
+	       p.hidden_us % 1000, p.max_stall_us);
+	report("guest time does not run ahead of the RTC",
+	       p.guest_us <= p.wall_us + 1000);
+	return report_summary();
+}
@@ -0,0 +1,228 @@
+/*
+ * MONITOR/MWAIT wakeup latency benchmark
+ *
+ * vCPU 1 goes idle and vCPU 0 wakes it up after idle= microseconds, with
+ * the idle/wakeup pair being one of:
+ *
+ * - hlt_ipi: HLT, woken by an IPI;
+ * - mwait_ipi: MWAIT on a monitored line, woken by an IPI;
+ * - mwait_store: MWAIT on a monitored line, woken by a store to it.
+ *
+ * The latency is the TSC delta from the wakeup event on vCPU 0 to vCPU 1
+ * running again.  Unless MWAIT exits are disabled on the host (QEMU's
+ * -overcommit cpu-pm=on), KVM treats MWAIT as a NOP; the number of times
+ * MWAIT returned per wakeup shows which case is in effect, since each
+ * spurious return is an exit with the line still unchanged.
+ *
+ * cpu-pm=on disables HLT and PAUSE exits as well, so with it hlt_ipi
+ * measures HLT running in the guest rather than a halt in KVM; that is
+ * why unittests.cfg also has mwait_bench_exits, which runs without it.
+ *
+ * Usage: -append "[idle=<us>] [samples=<n>] [hlt_ipi] [mwait_ipi] [mwait_store]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "smp.h"
+#include "apic.h"
+#include "isr.h"
+#include "vm.h"
+#include "delay.h"
+#include "util.h"
+
+#define WAKEUP_VECTOR	0xb3
+#define MAX_SAMPLES	10000
+
+enum {
+	HLT_IPI,
+	MWAIT_IPI,
+	MWAIT_STORE,
+	NR_MODES
+};
+
+static const char *mode_names[NR_MODES] = {
+	"hlt_ipi", "mwait_ipi", "mwait_store"
+};
+
+/* The monitored line, written by vCPU 0 to wake up vCPU 1. */
+static struct {
+	volatile int sample;
+} __attribute__((aligned(64))) line;
+
+static volatile bool woken;
+static volatile u64 arrival;
+static volatile int sample, armed;
+static volatile bool stop;
+static volatile int mode;
+static ulong mwait_returns;
+static u64 latency[MAX_SAMPLES];
+
+static inline void monitor(volatile void *addr)
+{
+	asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0));
+}
+
+static inline void mwait(void)
+{
+	asm volatile("mwait" : : "a"(0), "c"(0));
+}
+
+/* MWAIT with the interrupt shadow of STI, like safe_halt(). */
+static inline void safe_mwait(void)
+{
+	asm volatile("sti; mwait; cli" : : "a"(0), "c"(0));
+}
+
+static void wakeup_isr(isr_regs_t *regs)
+{
+	arrival = rdtsc();
+	woken = true;
+	eoi();
+}
+
+static void idle(int n)
+{
+	switch (mode) {
+	case HLT_IPI:
+		safe_halt();
+		irq_disable();
+		break;
+	case MWAIT_IPI:
+		while (!woken) {
+			monitor(&line);
+			if (!woken) {
+				safe_mwait();
+				mwait_returns++;
+			}
+		}
+		break;
+	case MWAIT_STORE:
+		while (line.sample != n) {
+			monitor(&line);
+			if (line.sample != n) {
+				mwait();
+				mwait_returns++;
+			}
+		}
+		arrival = rdtsc();
+		woken = true;
+		break;
+	}
+}
+
+static void receiver(void *data)
+{
+	int n = 0;
+
+	irq_disable();
+	for (;;) {
+		while (sample == n)
+			pause();
+		if (stop)
+			break;
+		n = sample;
+		woken = false;
+		armed = n;
+		idle(n);
+	}
+}
+
+static u64 wake(u64 idle_cycles)
+{
+	u64 t;
+
+	sample++;
+	while (armed != sample)
+		pause();
+
+	for (t = rdtsc(); rdtsc() - t < idle_cycles;)
+		pause();
+
+	t = rdtsc();
+	if (mode == MWAIT_STORE)
+		line.sample = sample;
+	else
+		apic_icr_write(APIC_DEST_PHYSICAL | APIC_DM_FIXED |
+			       WAKEUP_VECTOR, id_map[1]);
+	while (!woken)
+		pause();
+	return arrival - t;
+}
+
+static void run(int m, u64 idle_cycles, int samples)
+{
+	int i;
+
+	mode = m;
+	mwait_returns = 0;
+	for (i = 0; i < samples; i++)
+		latency[i] = wake(idle_cycles);
+	sort_u64(latency, samples);
+
+	printf("%-11s: p50 %6ld p99 %6ld max %6ld cycles", mode_names[m],
+	       latency[samples / 2], latency[samples * 99 / 100],
+	       latency[samples - 1]);
+	if (m != HLT_IPI)
+		printf(", %ld.%02ld mwait returns/wakeup",
+		       mwait_returns / samples,
+		       mwait_returns * 100 / samples % 100);
+	printf("\n");
+}
+
+int main(int ac, char **av)
+{
+	bool wanted[NR_MODES] = { false }, any = false;
+	long idle_us = 100, samples = 1000, val;
+	u64 khz;
+	int i, m;
+
+	setup_vm();
+	smp_init();
+
+	for (i = 1; i < ac; i++) {
+		if (parse_keyval(av[i], &val) > 0) {
+			if (!strncmp(av[i], "idle=", 5))
+				idle_us = val;
+			else if (!strncmp(av[i], "samples=", 8))
+				samples = val;
+			else
+				report_abort("unknown argument: %s", av[i]);
+			continue;
+		}
+		for (m = 0; m < NR_MODES; m++)
+			if (!strcmp(av[i], mode_names[m]))
+				break;
+		if (m == NR_MODES)
+			report_abort("unknown argument: %s", av[i]);
+		wanted[m] = any = true;
+	}
+	if (!any)
+		for (m = 0; m < NR_MODES; m++)
+			wanted[m] = true;
+
+	if (samples < 1 || samples > MAX_SAMPLES)
+		report_abort("invalid samples=%ld", samples);
+	if (cpu_count() < 2)
+		report_abort("needs 2 vcpus");
+	if (!this_cpu_has(X86_FEATURE_MWAIT)) {
+		report_skip("MONITOR/MWAIT not available");
+		wanted[MWAIT_IPI] = wanted[MWAIT_STORE] = false;
+	}
+
+	khz = tsc_khz();
+	if (!khz)
+		report_abort("cannot determine the TSC frequency");
+
+	handle_irq(WAKEUP_VECTOR, wakeup_isr);
+	on_cpu_async(1, receiver, NULL);
+
+	printf("idle %ld us, %ld samples, TSC %ld kHz\n", idle_us, samples, khz);
+	for (m = 0; m < NR_MODES; m++)
+		if (wanted[m])
+			run(m, idle_us * khz / 1000, samples);
+
+	stop = true;
+	sample++;
+	return report_summary();
+}
@@ -0,0 +1,238 @@
+/*
+ * Lock-holder preemption benchmark
+ *
+ * All vCPUs take turns on a ticket spinlock, holding it for hold= cycles.
+ * With more vCPUs than host CPUs the lock holder regularly gets preempted,
+ * and since a ticket lock is FIFO the next waiter in line may be preempted
+ * too; everybody else burns their time slice spinning.  Three ways to wait
+ * are compared:
+ *
+ * - nopause: a bare spin loop, which pause-loop exiting never sees;
+ * - pause: spin with PAUSE, which PLE/pause filtering turns into exits
+ *   and directed yields on the host;
+ * - pvkick: spin with PAUSE for a while, then HLT until the unlocker
+ *   kicks the vCPU with KVM_HC_KICK_CPU, like Linux's PV spinlocks.
+ *
+ * For each, lock throughput and the share of vCPU time spent waiting for
+ * the lock are reported.  Run it with QEMU restricted to fewer host CPUs
+ * than vCPUs, e.g. with taskset, and compare the results for different
+ * ple_gap/ple_window settings of kvm_intel (or pause_filter_count and
+ * pause_filter_thresh of kvm_amd); ple_gap=0 disables PLE.
+ *
+ * Usage: -append "[ms=<time per mode>] [hold=<cycles>] [nopause] [pause] [pvkick]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "smp.h"
+#include "atomic.h"
+#include "apic.h"
+#include "delay.h"
+#include "kvm_para.h"
+#include "locks.h"
+#include "util.h"
+
+#define SPIN_THRESHOLD	(1 << 11)
+
+enum {
+	WAIT_NOPAUSE,
+	WAIT_PAUSE,
+	WAIT_PVKICK,
+	NR_MODES
+};
+
+static const char *mode_names[NR_MODES] = { "nopause", "pause", "pvkick" };
+
+struct ple_stats {
+	ulong acquired;
+	ulong errors;
+	ulong halts;
+	ulong kicks;
+	u64 wait_cycles;
+};
+
+static DEFINE_PER_CPU(struct ple_stats, stats);
+/* The ticket a halted vCPU waits for, -1 when it is not halted. */
+static DEFINE_PER_CPU(volatile int, halted_on) = -1;
+
+static struct ticket_lock lock;
+static volatile int owner = -1;
+static int mode, nr_cpus;
+static u64 hold, duration;
+static atomic_t nr_arrived;
+
+static void wait_halted(unsigned int ticket)
+{
+	ulong rflags = read_rflags();
+
+	this_cpu(halted_on) = ticket;
+	__sync_synchronize();
+
+	/* HLT with IF=0 still wakes up on a kick. */
+	irq_disable();
+	if (*(volatile unsigned int *)&lock.owner != ticket) {
+		asm volatile("hlt");
+		this_cpu(stats).halts++;
+	}
+	if (rflags & X86_EFLAGS_IF)
+		irq_enable();
+
+	this_cpu(halted_on) = -1;
+}
+
+static void acquire(void)
+{
+	unsigned int ticket = __sync_fetch_and_add(&lock.next, 1);
+	u64 t = rdtsc();
+	int i;
+
+	for (;;) {
+		for (i = 0; i < SPIN_THRESHOLD; i++) {
+			if (*(volatile unsigned int *)&lock.owner == ticket)
+				goto out;
+			if (mode != WAIT_NOPAUSE)
+				pause();
+		}
+		if (mode == WAIT_PVKICK)
+			wait_halted(ticket);
+	}
+out:
+	__sync_synchronize();
+	this_cpu(stats).wait_cycles += rdtsc() - t;
+}
+
+static void release(void)
+{
+	unsigned int next;
+	int i, id;
+
+	next = __sync_add_and_fetch(&lock.owner, 1);
+	if (mode != WAIT_PVKICK)
+		return;
+
+	for (i = 0; i < nr_cpus; i++) {
+		id = id_map[i];
+		if (per_cpu(halted_on, id) == next) {
+			kvm_hypercall2(KVM_HC_KICK_CPU, 0, id);
+			this_cpu(stats).kicks++;
+			break;
+		}
+	}
+}
+
+static void hammer(void *data)
+{
+	struct ple_stats *s = this_cpu_ptr(stats);
+	u64 start, t;
+	int id = smp_id();
+
+	memset(s, 0, sizeof(*s));
+	atomic_inc(&nr_arrived);
+	while (atomic_read(&nr_arrived) < nr_cpus)
+		pause();
+
+	start = rdtsc();
+	while (rdtsc() - start < duration) {
+		acquire();
+		if (owner != -1)
+			s->errors++;
+		owner = id;
+		for (t = rdtsc(); rdtsc() - t < hold;)
+			;
+		if (owner != id)
+			s->errors++;
+		owner = -1;
+		release();
+		s->acquired++;
+	}
+}
+
+static bool run(int m, u64 khz)
+{
+	ulong acquired = 0, errors = 0, halts = 0, kicks = 0;
+	u64 wait = 0;
+	struct ple_stats *s;
+	int i;
+
+	mode = m;
+	atomic_set(&nr_arrived, 0);
+	on_cpus(hammer, NULL);
+
+	for (i = 0; i < nr_cpus; i++) {
+		s = per_cpu_ptr(stats, id_map[i]);
+		acquired += s->acquired;
+		errors += s->errors;
+		halts += s->halts;
+		kicks += s->kicks;
+		wait += s->wait_cycles;
+	}
+
+	printf("%-8s %d vcpus: %8ld acquisitions", mode_names[m], nr_cpus,
+	       acquired);
+	if (khz)
+		printf(", %ld/s", acquired * khz * 1000 / duration);
+	printf(", %ld cycles/wait, %ld%% waiting", wait / acquired,
+	       wait * 100 / (duration * nr_cpus));
+	if (m == WAIT_PVKICK)
+		printf(", %ld halts, %ld kicks", halts, kicks);
+	printf("\n");
+
+	return errors == 0;
+}
+
+static bool mode_wanted(int m, char **wanted, int nwanted)
+{
+	int i;
+
+	if (!nwanted)
+		return true;
+
+	for (i = 0; i < nwanted; i++)
+		if (!strcmp(wanted[i], mode_names[m]))
+			return true;
+
+	return false;
+}
+
+int main(int ac, char **av)
+{
+	char *wanted[NR_MODES];
+	int nwanted = 0, i;
+	long ms = 1000, val;
+	u64 khz;
+
+	smp_init();
+	nr_cpus = cpu_count();
+	hold = 1000;
+
+	for (i = 1; i < ac; i++) {
+		if (!strncmp(av[i], "ms=", 3) && parse_keyval(av[i], &val) > 0)
+			ms = val;
+		else if (!strncmp(av[i], "hold=", 5) &&
+			 parse_keyval(av[i], &val) > 0)
+			hold = val;
+		else if (nwanted < NR_MODES)
+			wanted[nwanted++] = av[i];
+		else
+			report_abort("too many arguments");
+	}
+
+	khz = tsc_khz();
+	duration = (khz ? khz : 1000000) * ms;
+	printf("%d vcpus, %ld ms per mode, lock held for %ld cycles%s\n",
+	       nr_cpus, ms, hold, khz ? "" : ", TSC frequency unknown");
+
+	for (i = 0; i < NR_MODES; i++) {
+		if (!mode_wanted(i, wanted, nwanted))
+			continue;
+		if (i == WAIT_PVKICK &&
+		    !kvm_para_has_feature(KVM_FEATURE_PV_UNHALT)) {
+			report_skip("pvkick: KVM_FEATURE_PV_UNHALT not available");
+			continue;
+		}
+		report("%s: mutual exclusion", run(i, khz), mode_names[i]);
+	}
+
+	return report_summary();
+}
@@ -0,0 +1,180 @@
+/*
+ * Multicast IPI benchmark: KVM PV send-IPI hypercall vs. ICR writes
+ *
+ * vCPU 0 repeatedly sends one IPI to a set of 1, 2, 4... other vCPUs,
+ * either with one ICR write per target (x2APIC if enabled, xAPIC
+ * otherwise) or with KVM_HC_SEND_IPI, which takes a bitmap of up to 128
+ * APIC ids per hypercall.  Each round waits for all targets to take the
+ * interrupt before starting the next one.  Reported are the sender's cost
+ * per round and the delivery latency, i.e. the TSC delta from the start of
+ * the round to the interrupt handler on the target, averaged over all
+ * targets and for the last target of each round.
+ *
+ * By default the targets sit in HLT; with "poll" they spin with
+ * interrupts enabled instead, which leaves out the wakeup cost.
+ *
+ * Usage: -append "[rounds=<n>] [poll] [icr] [pv]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "smp.h"
+#include "atomic.h"
+#include "apic.h"
+#include "isr.h"
+#include "vm.h"
+#include "kvm_para.h"
+#include "util.h"
+
+#define IPI_VECTOR	0xb1
+
+enum {
+	SEND_ICR,
+	SEND_PV,
+	NR_METHODS
+};
+
+static const char *method_names[NR_METHODS] = { "icr", "pv" };
+
+static DEFINE_PER_CPU(u64, arrival);
+
+static u64 round_start;
+static atomic_t nr_received;
+static volatile bool stop_polling;
+static int nr_cpus;
+
+static void ipi_isr(isr_regs_t *regs)
+{
+	this_cpu(arrival) = rdtsc();
+	atomic_inc(&nr_received);
+	eoi();
+}
+
+static void poll(void *data)
+{
+	irq_enable();
+	while (!stop_polling)
+		pause();
+}
+
+static void send_icr(int *ids, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		apic_icr_write(APIC_DEST_PHYSICAL | APIC_DM_FIXED | IPI_VECTOR,
+			       ids[i]);
+}
+
+/* Like Linux's __send_ipi_mask(), one hypercall per 128 ids window. */
+static void send_pv(int *ids, int n)
+{
+	unsigned long bitmap[2];
+	int i, min;
+
+	for (i = 0; i < n;) {
+		min = ids[i];
+		bitmap[0] = bitmap[1] = 0;
+		for (; i < n && ids[i] >= min && ids[i] - min < 128; i++)
+			bitmap[(ids[i] - min) / 64] |= 1ul << ((ids[i] - min) % 64);
+		kvm_hypercall4(KVM_HC_SEND_IPI, bitmap[0], bitmap[1], min,
+			       APIC_DM_FIXED | IPI_VECTOR);
+	}
+}
+
+static void run(int method, int *ids, int n, long rounds)
+{
+	u64 t, cost = 0, latency = 0, last, last_total = 0;
+	long r;
+	int i;
+
+	for (r = 0; r < rounds; r++) {
+		atomic_set(&nr_received, 0);
+		round_start = t = rdtsc();
+		if (method == SEND_PV)
+			send_pv(ids, n);
+		else
+			send_icr(ids, n);
+		cost += rdtsc() - t;
+
+		while (atomic_read(&nr_received) < n)
+			pause();
+
+		last = 0;
+		for (i = 0; i < n; i++) {
+			t = per_cpu(arrival, ids[i]) - round_start;
+			latency += t;
+			last = MAX(last, t);
+		}
+		last_total += last;
+	}
+
+	printf("%-3s %3d targets: %8ld cycles/send, latency %8ld cycles (last %ld)\n",
+	       method_names[method], n, cost / rounds,
+	       latency / (rounds * n), last_total / rounds);
+}
+
+/* 1, 2, 4... targets, always ending with all of them */
+static int next_targets(int n)
+{
+	return n == nr_cpus - 1 ? nr_cpus : MIN(n * 2, nr_cpus - 1);
+}
+
+int main(int ac, char **av)
+{
+	bool wanted[NR_METHODS] = { false }, any = false, polling = false;
+	int ids[MAX_TEST_CPUS];
+	long rounds = 10000, val;
+	int i, m, n;
+
+	setup_vm();
+	smp_init();
+	nr_cpus = cpu_count();
+
+	for (i = 1; i < ac; i++) {
+		if (!strncmp(av[i], "rounds=", 7) && parse_keyval(av[i], &val) > 0) {
+			rounds = val;
+			continue;
+		}
+		if (!strcmp(av[i], "poll")) {
+			polling = true;
+			continue;
+		}
+		for (m = 0; m < NR_METHODS; m++)
+			if (!strcmp(av[i], method_names[m]))
+				break;
+		if (m == NR_METHODS)
+			report_abort("unknown argument: %s", av[i]);
+		wanted[m] = any = true;
+	}
+	if (!any)
+		for (m = 0; m < NR_METHODS; m++)
+			wanted[m] = true;
+
+	if (nr_cpus < 2 || rounds < 1)
+		report_abort("needs at least 2 vcpus and 1 round");
+	if (wanted[SEND_PV] && !kvm_para_has_feature(KVM_FEATURE_PV_SEND_IPI)) {
+		report_skip("pv: KVM_FEATURE_PV_SEND_IPI not available");
+		wanted[SEND_PV] = false;
+	}
+
+	handle_irq(IPI_VECTOR, ipi_isr);
+	for (i = 1; i < nr_cpus; i++) {
+		ids[i - 1] = id_map[i];
+		if (polling)
+			on_cpu_async(i, poll, NULL);
+	}
+
+	printf("%d targets %s, %s, %ld rounds\n", nr_cpus - 1,
+	       polling ? "polling" : "halted",
+	       rdmsr(MSR_IA32_APICBASE) & APIC_EXTD ? "x2APIC" : "xAPIC",
+	       rounds);
+	for (m = 0; m < NR_METHODS; m++)
+		if (wanted[m])
+			for (n = 1; n < nr_cpus; n = next_targets(n))
+				run(m, ids, n, rounds);
+
+	stop_polling = true;
+	return report_summary();
+}
@@ -0,0 +1,207 @@
+/*
+ * Shadow/TDP MMU rmap scaling benchmark
+ *
+ * A generalization of rmap_chain: every vCPU creates n aliases of one
+ * shared target page, instantiates them by touching each alias, and tears
+ * them down again.  The three phases are timed separately and reported in
+ * TSC cycles per mapping, for n doubling from min= up to max=.  A cost per
+ * mapping that grows with n points at O(n^2) rmap handling, one that grows
+ * with the number of vCPUs points at mmu_lock contention.
+ *
+ * Usage: -append "min=<n> max=<n>"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "fwcfg.h"
+#include "vm.h"
+#include "vmalloc.h"
+#include "smp.h"
+#include "atomic.h"
+#include "apic.h"
+#include "alloc_page.h"
+#include "util.h"
+
+/* Well above the identity map, so that aliases never collide with it. */
+#define ALIAS_BASE	(1ul << 40)
+
+enum {
+	PHASE_CREATE,
+	PHASE_TOUCH,
+	PHASE_TEARDOWN,
+	NR_PHASES
+};
+
+static const char *phase_names[NR_PHASES] = { "create", "touch", "teardown" };
+
+static pgd_t *cr3;
+static void *target_page;
+static ulong region_size;
+static long nr_aliases;
+static int nr_cpus;
+static atomic_t nr_arrived;
+static u64 cycles[MAX_TEST_CPUS][NR_PHASES];
+
+/* Each vCPU owns a separate, 2M aligned range of alias addresses. */
+static void *alias_base(int id)
+{
+	return (void *)(ALIAS_BASE + id * region_size);
+}
+
+/* Each vCPU writes to its own cache line of the target page. */
+static volatile ulong *alias_slot(void *virt, int id)
+{
+	return virt + (id % (PAGE_SIZE / 64)) * 64;
+}
+
+/* Make all vCPUs start a phase together, on_cpus() starts them one by one. */
+static void wait_for_all(void)
+{
+	atomic_inc(&nr_arrived);
+	while (atomic_read(&nr_arrived) < nr_cpus)
+		pause();
+}
+
+static void load_cr3(void *data)
+{
+	write_cr3(virt_to_phys(cr3));
+}
+
+static void create_aliases(void *data)
+{
+	int id = smp_id();
+	void *virt = alias_base(id);
+	u64 t;
+	long i;
+
+	wait_for_all();
+	t = rdtsc();
+	for (i = 0; i < nr_aliases; i++, virt += PAGE_SIZE)
+		install_page(cr3, virt_to_phys(target_page), virt);
+	cycles[id][PHASE_CREATE] = rdtsc() - t;
+}
+
+static void touch_aliases(void *data)
+{
+	int id = smp_id();
+	void *virt = alias_base(id);
+	u64 t;
+	long i;
+
+	wait_for_all();
+	t = rdtsc();
+	for (i = 0; i < nr_aliases; i++, virt += PAGE_SIZE)
+		*alias_slot(virt, id) = i;
+	cycles[id][PHASE_TOUCH] = rdtsc() - t;
+}
+
+static void teardown_aliases(void *data)
+{
+	int id = smp_id();
+	void *virt = alias_base(id);
+	u64 t;
+	long i;
+
+	wait_for_all();
+	t = rdtsc();
+	for (i = 0; i < nr_aliases; i++, virt += PAGE_SIZE)
+		*get_pte(cr3, virt) = 0;
+	write_cr3(read_cr3());
+	cycles[id][PHASE_TEARDOWN] = rdtsc() - t;
+}
+
+static void run_phase(int phase)
+{
+	static void (*phase_fns[NR_PHASES])(void *) = {
+		create_aliases, touch_aliases, teardown_aliases
+	};
+
+	atomic_set(&nr_arrived, 0);
+	on_cpus(phase_fns[phase], NULL);
+}
+
+/*
+ * Build the page table pages for every alias up front, so that concurrent
+ * install_page() calls only ever write leaf PTEs of their own vCPU.
+ */
+static void prepare_page_tables(long max)
+{
+	void *virt;
+	int i;
+
+	for (i = 0; i < nr_cpus; i++)
+		for (virt = alias_base(id_map[i]);
+		     virt < alias_base(id_map[i]) + max * PAGE_SIZE;
+		     virt += LARGE_PAGE_SIZE)
+			install_pte(cr3, 1, virt, 0, 0);
+}
+
+static bool check_aliases(void)
+{
+	int i;
+
+	for (i = 0; i < nr_cpus; i++)
+		if (*alias_slot(target_page, id_map[i]) != nr_aliases - 1)
+			return false;
+	return true;
+}
+
+static void print_step(void)
+{
+	u64 slowest;
+	int phase, i;
+
+	printf("%8ld aliases x %d vcpus:", nr_aliases, nr_cpus);
+	for (phase = 0; phase < NR_PHASES; phase++) {
+		slowest = 0;
+		for (i = 0; i < nr_cpus; i++)
+			slowest = MAX(slowest, cycles[id_map[i]][phase]);
+		printf(" %s %ld", phase_names[phase], slowest / nr_aliases);
+	}
+	printf(" cycles/mapping\n");
+}
+
+int main(int ac, char **av)
+{
+	long min = 1024, max, val;
+	bool ok = true;
+	int i;
+
+	setup_vm();
+	smp_init();
+
+	nr_cpus = cpu_count();
+	max = (fwcfg_get_u64(FW_CFG_RAM_SIZE) / PAGE_SIZE - 1000) / nr_cpus;
+
+	for (i = 1; i < ac; i++) {
+		if (parse_keyval(av[i], &val) < 0)
+			report_abort("bad argument: %s", av[i]);
+		if (!strncmp(av[i], "min=", 4))
+			min = val;
+		else if (!strncmp(av[i], "max=", 4))
+			max = val;
+		else
+			report_abort("unknown argument: %s", av[i]);
+	}
+	if (min < 1 || max < min)
+		report_abort("invalid range min=%ld max=%ld", min, max);
+
+	cr3 = current_page_table();
+	target_page = alloc_page();
+	region_size = ALIGN(max * PAGE_SIZE, LARGE_PAGE_SIZE);
+	prepare_page_tables(max);
+	on_cpus(load_cr3, NULL);
+
+	printf("%d vcpus, %ld to %ld aliases per vcpu\n", nr_cpus, min, max);
+	for (nr_aliases = min; nr_aliases <= max; nr_aliases *= 2) {
+		for (i = 0; i < NR_PHASES; i++) {
+			run_phase(i);
+			if (i == PHASE_TOUCH)
+				ok &= check_aliases();
+		}
+		print_step();
+	}
+
+	report("aliases map the target page", ok);
+	return report_summary();
+}
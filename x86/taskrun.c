@@ -0,0 +1,79 @@
+/*
+ * Task runner selftest
+ *
+ * Splits a range of items into uneven chunks, submits them to the task
+ * runner and has every task split its chunk further with task_spawn()
+ * until it is small enough to work on.  Checks that all CPUs took part
+ * and that every item was visited exactly once.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "smp.h"
+#include "taskrun.h"
+#include "asm-generic/atomic.h"
+
+#define NR_ITEMS	65536
+#define LEAF_ITEMS	64
+#define NR_RANGES	(2 * NR_ITEMS / LEAF_ITEMS)
+
+struct range {
+	int lo, hi;
+};
+
+static int hits[NR_ITEMS];
+static struct range ranges[NR_RANGES];
+static int nr_ranges, nr_tasks;
+
+static struct range *new_range(int lo, int hi)
+{
+	int i = atomic_fetch_inc(&nr_ranges);
+
+	assert(i < NR_RANGES);
+	ranges[i].lo = lo;
+	ranges[i].hi = hi;
+	return &ranges[i];
+}
+
+static void visit(struct task_worker *w, void *data)
+{
+	struct range *r = data;
+	int i, mid;
+
+	atomic_fetch_inc(&nr_tasks);
+	while (r->hi - r->lo > LEAF_ITEMS) {
+		mid = r->lo + (r->hi - r->lo) / 2;
+		task_spawn(w, visit, new_range(mid, r->hi));
+		r->hi = mid;
+	}
+	for (i = r->lo; i < r->hi; i++)
+		hits[i]++;
+}
+
+int main(void)
+{
+	int i, lo, nr_workers, bad = 0;
+
+	smp_init();
+
+	/* Chunks of 1, 2, 4... leaves, the rest in the last one */
+	for (i = 0, lo = 0; lo < NR_ITEMS; i++) {
+		int hi = MIN(lo + (LEAF_ITEMS << i), NR_ITEMS);
+
+		task_submit(visit, new_range(lo, hi));
+		lo = hi;
+	}
+
+	nr_workers = task_run();
+	task_print_stats();
+
+	for (i = 0; i < NR_ITEMS; i++)
+		if (hits[i] != 1)
+			bad++;
+
+	report("%d workers", nr_workers == cpu_count(), nr_workers);
+	report("%d tasks", nr_tasks == nr_ranges, nr_tasks);
+	report("every item visited once", !bad);
+
+	return report_summary();
+}
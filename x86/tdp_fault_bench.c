@@ -0,0 +1,197 @@
+/*
+ * EPT/NPT violation fault-in throughput benchmark
+ *
+ * Touches guest memory that was never accessed before, so that the first
+ * access to each page takes a TDP violation exit and KVM has to fault in
+ * the backing host page.  Memory is touched with a 4K or a 2M stride, by
+ * reads or by writes, from 1, 2, 4... vCPUs concurrently, and every
+ * combination is reported as faults per second and cost per fault.  With
+ * host THP a 4K stride only faults once per 2M, which shows up as a much
+ * lower cost per touch.
+ *
+ * The test must not call setup_vm(): building the page allocator's free
+ * list would write to every page of guest memory.  It runs on the boot
+ * page tables instead, which identity map the first 4G with 2M pages.
+ *
+ * Usage: -append "[mem=<MB per run>] [4k_read] [4k_write] [2m_read] [2m_write]"
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "atomic.h"
+#include "smp.h"
+#include "apic.h"
+#include "delay.h"
+#include "alloc_phys.h"
+#include "asm/page.h"
+#include "util.h"
+
+struct pattern {
+	const char *name;
+	ulong stride;
+	bool write;
+};
+
+static struct pattern patterns[] = {
+	{ "4k_read", PAGE_SIZE, false },
+	{ "4k_write", PAGE_SIZE, true },
+	{ "2m_read", LARGE_PAGE_SIZE, false },
+	{ "2m_write", LARGE_PAGE_SIZE, true },
+};
+
+struct fault_stats {
+	u64 cycles;
+	u64 max;
+	ulong faults;
+} __attribute__((aligned(64)));
+
+static struct fault_stats stats[MAX_TEST_CPUS];
+static struct pattern *cur;
+static u8 *run_base;
+static ulong run_size, chunk;
+static int nr_cpus, nr_workers;
+static atomic_t nr_arrived;
+
+static int cpu_index(void)
+{
+	int i, id = smp_id();
+
+	for (i = 0; i < nr_cpus; i++)
+		if (id_map[i] == id)
+			return i;
+	return -1;
+}
+
+static void fault_in(void *data)
+{
+	int idx = cpu_index();
+	struct fault_stats *s;
+	u8 *p, *end;
+	u64 t0, t, lat;
+
+	if (idx >= nr_workers)
+		return;
+
+	s = &stats[idx];
+	p = run_base + idx * chunk;
+	end = p + chunk;
+	s->max = 0;
+	s->faults = 0;
+
+	atomic_inc(&nr_arrived);
+	while (atomic_read(&nr_arrived) < nr_workers)
+		pause();
+
+	t0 = rdtsc();
+	for (; p < end; p += cur->stride) {
+		t = rdtsc();
+		if (cur->write)
+			*(volatile u8 *)p = 1;
+		else
+			(void)*(volatile u8 *)p;
+		lat = rdtsc() - t;
+		s->max = MAX(s->max, lat);
+		s->faults++;
+	}
+	s->cycles = rdtsc() - t0;
+}
+
+static void run(struct pattern *pattern, int workers)
+{
+	u64 slowest = 0, total = 0, max = 0, khz = tsc_khz();
+	ulong faults = 0;
+	int i;
+
+	cur = pattern;
+	nr_workers = workers;
+	chunk = (run_size / workers) & ~(LARGE_PAGE_SIZE - 1);
+	atomic_set(&nr_arrived, 0);
+	on_cpus(fault_in, NULL);
+	run_base += run_size;
+
+	for (i = 0; i < workers; i++) {
+		slowest = MAX(slowest, stats[i].cycles);
+		max = MAX(max, stats[i].max);
+		total += stats[i].cycles;
+		faults += stats[i].faults;
+	}
+
+	printf("%-8s %3d vcpus: %8ld faults, %8ld cycles/fault (max %ld)",
+	       pattern->name, workers, faults, total / faults, max);
+	if (khz)
+		printf(", %ld faults/s, %ld ns/fault",
+		       faults * khz * 1000 / slowest,
+		       total * 1000000 / khz / faults);
+	printf("\n");
+}
+
+/* 1, 2, 4... vCPUs, always ending with all of them */
+static int next_workers(int workers)
+{
+	return workers == nr_cpus ? nr_cpus + 1 : MIN(workers * 2, nr_cpus);
+}
+
+static bool pattern_wanted(struct pattern *pattern, char **wanted, int nwanted)
+{
+	int i;
+
+	if (!nwanted)
+		return true;
+
+	for (i = 0; i < nwanted; i++)
+		if (!strcmp(wanted[i], pattern->name))
+			return true;
+
+	return false;
+}
+
+int main(int ac, char **av)
+{
+	char *wanted[ARRAY_SIZE(patterns)];
+	int nwanted = 0, nr_runs = 0, i, workers;
+	phys_addr_t base, top;
+	long val;
+
+	smp_init();
+	nr_cpus = cpu_count();
+
+	for (i = 1; i < ac; i++) {
+		if (!strncmp(av[i], "mem=", 4) && parse_keyval(av[i], &val) > 0)
+			run_size = val << 20;
+		else if (nwanted < ARRAY_SIZE(wanted))
+			wanted[nwanted++] = av[i];
+		else
+			report_abort("too many arguments");
+	}
+
+	for (i = 0; i < ARRAY_SIZE(patterns); i++)
+		if (pattern_wanted(&patterns[i], wanted, nwanted))
+			for (workers = 1; workers <= nr_cpus;
+			     workers = next_workers(workers))
+				nr_runs++;
+	if (!nr_runs)
+		report_abort("no pattern selected");
+
+	/* Everything above the test image has never been touched. */
+	phys_alloc_get_unused(&base, &top);
+	base = ALIGN(base, LARGE_PAGE_SIZE);
+	top = MIN(top, 1ull << 32) & ~(LARGE_PAGE_SIZE - 1);
+	if (!run_size)
+		run_size = ((top - base) / nr_runs) & ~(LARGE_PAGE_SIZE - 1);
+	if (run_size < nr_cpus * LARGE_PAGE_SIZE ||
+	    base + run_size * nr_runs > top)
+		report_abort("not enough memory for %d runs of %ld MB",
+			     nr_runs, run_size >> 20);
+	run_base = (u8 *)(ulong)base;
+
+	printf("%d runs of %ld MB, TSC %ld kHz\n",
+	       nr_runs, run_size >> 20, tsc_khz());
+	for (i = 0; i < ARRAY_SIZE(patterns); i++)
+		if (pattern_wanted(&patterns[i], wanted, nwanted))
+			for (workers = 1; workers <= nr_cpus;
+			     workers = next_workers(workers))
+				run(&patterns[i], workers);
+
+	return 0;
+}
@@ -14,10 +14,13 @@
  *
  * # cd /sys/kernel/debug/tracing/
  * # echo x86-tsc > trace_clock
- * # echo "kvm_exit kvm_entry kvm_msr" > set_event
+ * # echo "kvm_exit kvm_entry kvm_msr kvm_hypercall" > set_event
  * # echo "sched_switch $extratracepoints" >> set_event
  * # echo apic_timer_fn > set_ftrace_filter
  * # echo "function" > current_tracer
+ *
+ * Hitting breakmax leaves a guest marker with the latency in the trace,
+ * scripts/trace_align.py shows the host events leading up to it.
  */
 
 #include "libcflat.h"
@@ -27,6 +30,7 @@
 #include "desc.h"
 #include "isr.h"
 #include "msr.h"
+#include "trace.h"
 
 static void test_lapic_existence(void)
 {
@@ -38,6 +42,7 @@ static void test_lapic_existence(void)
 }
 
 #define TSC_DEADLINE_TIMER_VECTOR 0xef
+#define TRACE_HITMAX 0
 
 static int tdt_count;
 u64 exptime;
@@ -58,6 +63,7 @@ static void tsc_deadline_timer_isr(isr_regs_t *regs)
 
     if (breakmax && tdt_count > 1 && (now - exptime) > breakmax) {
         hitmax = 1;
+        trace_mark(TRACE_HITMAX, now - exptime);
         apic_write(APIC_EOI, 0);
         return;
     }
@@ -115,6 +121,8 @@ int main(int argc, char **argv)
     size = argc <= 2 ? TABLE_SIZE : atol(argv[2]);
     breakmax = argc <= 3 ? 0 : atol(argv[3]);
     printf("breakmax=%d\n", breakmax);
+    if (breakmax)
+        trace_init(0);
     test_tsc_deadline_timer();
     irq_enable();
 
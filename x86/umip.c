@@ -113,9 +113,14 @@ static void test_umip_gp(const char *msg)
 
 /* The ugly mode switching code */
 
+/*
+ * Loading %gs clears the base of the per-CPU area that report() goes
+ * through, so it is put back both for the ring 3 code and after it.
+ */
 static int do_ring3(void (*fn)(const char *), const char *arg)
 {
     static unsigned char user_stack[4096];
+    u64 gs_base = rdmsr(MSR_GS_BASE);
     int ret;
 
     asm volatile ("mov %[user_ds], %%" R "dx\n\t"
@@ -123,6 +128,11 @@ static int do_ring3(void (*fn)(const char *), const char *arg)
 		  "mov %%dx, %%es\n\t"
 		  "mov %%dx, %%fs\n\t"
 		  "mov %%dx, %%gs\n\t"
+		  "mov %[gs_base_lo], %%eax\n\t"
+		  "mov %[gs_base_hi], %%edx\n\t"
+		  "mov %[msr_gs_base], %%ecx\n\t"
+		  "wrmsr\n\t"
+		  "mov %[user_ds], %%" R "dx\n\t"
 		  "mov %%" R "sp, %%" R "cx\n\t"
 		  "push" W " %%" R "dx \n\t"
 		  "lea %[user_stack_top], %%" R "dx \n\t"
@@ -163,8 +173,12 @@ static int do_ring3(void (*fn)(const char *), const char *arg)
 		    [fn]"r"(fn),
 		    [arg]"D"(arg),
 		    [kernel_ds]"i"(KERNEL_DS),
-		    [kernel_entry_vector]"i"(0x20)
+		    [kernel_entry_vector]"i"(0x20),
+		    [gs_base_lo]"m"(((u32 *)&gs_base)[0]),
+		    [gs_base_hi]"m"(((u32 *)&gs_base)[1]),
+		    [msr_gs_base]"i"(MSR_GS_BASE)
 		  : "rcx", "rdx");
+    wrmsr(MSR_GS_BASE, gs_base);
     return ret;
 }
 